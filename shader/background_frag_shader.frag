@@ -2,9 +2,16 @@
 
 layout (location = 0) out vec4 color;
 
-in vec4 v_Color;
+in vec2 v_CanvasCoords;
+
+// Side of a checker cell, in canvas pixels
+const float c_CellSize = 6.0f;
+const vec4 c_DarkColor = vec4(vec3(131.0f / 255.0f), 1.0f);
+const vec4 c_LightColor = vec4(vec3(201.0f / 255.0f), 1.0f);
 
 void main()
 {
-	color = v_Color;
+	vec2 cell = floor(v_CanvasCoords / c_CellSize);
+	float parity = mod(cell.x + cell.y, 2.0f);
+	color = mix(c_DarkColor, c_LightColor, parity);
 }
@@ -1,14 +1,13 @@
 #version 330 core
 
 layout (location = 0) in vec2 a_Position;
-layout (location = 1) in vec4 a_Color;
 
-out vec4 v_Color;
+out vec2 v_CanvasCoords;
 
 uniform mat4 u_ViewProjection;
 
 void main()
 {
 	gl_Position = u_ViewProjection * vec4(a_Position, 0.0f, 1.0f);
-	v_Color = a_Color;
+	v_CanvasCoords = a_Position;
 }
@@ -0,0 +1,20 @@
+#version 330 core
+
+layout (location = 0) out vec4 color;
+
+in vec2 v_TexCoord;
+
+uniform sampler2D u_Texture;
+uniform float u_Opacity;
+
+void main()
+{
+	color = texture(u_Texture, v_TexCoord);
+
+	// Layer opacity replaces the alpha of drawn pixels, same as in
+	// Layers::GetDisplayedCanvas
+	if (color.a > 0.0f)
+	{
+		color.a = u_Opacity;
+	}
+}
@@ -104,9 +104,11 @@ void UI::RenderUI(Layers& layers, Camera& camera)
     RenderLayerWindow(layers);
     RenderUndoTreeWindow(layers);
 
-    if (mRenderSaveAsImgPopup) { RenderSaveAsImagePopup(); }
+    if (mRenderSaveAsImgPopup) { RenderSaveAsImagePopup(layers); }
     if (mRenderSaveAsPrjPopup) { RenderSaveAsProjectPopup(); }
+    RenderSaveProgress();
     if (mRenderSaveErrorPopup) { RenderSaveErrorPopup(); }
+    if (mRenderExportReportPopup) { RenderExportReportPopup(); }
 }
 
 void UI::RenderNoProjectWindow()
@@ -115,6 +117,11 @@ void UI::RenderNoProjectWindow()
 
     if (ImGui::Selectable("New project")) { mRenderNewProjectPopup = true; }
     if (ImGui::Selectable("Open a project")) { mRenderOpenProjectPopup = true; }
+    if (Project::HasUnsavedProjectToRecover() &&
+        ImGui::Selectable("Recover unsaved project"))
+    {
+        mProject.get().RecoverUnsavedProject();
+    }
 
     ImGui::End();
 
@@ -237,6 +244,11 @@ void UI::RenderMenuBar(Layers& layers, Camera& camera)
         {
             mRenderSaveAsPrjPopup = true;
         }
+        bool autosave = mProject.get().IsAutosaveEnabled();
+        if (ImGui::MenuItem("Autosave", nullptr, &autosave))
+        {
+            mProject.get().SetAutosaveEnabled(autosave);
+        }
         ImGui::EndMenu();
     }
 
@@ -262,13 +274,16 @@ void UI::RenderMenuBar(Layers& layers, Camera& camera)
     ImGui::EndMainMenuBar();
 }
 
-void UI::RenderSaveAsImagePopup()
+void UI::RenderSaveAsImagePopup(const Layers& layers)
 {
     mShouldDoTool = false; // Don't want to draw with a popup opened
 
     static std::array<char, 256> destination_str;
     static std::array<char, 64> file_name_str;
     static int magnify_factor = 1;
+    static auto encoder = Project::PngEncoder::kFast;
+    static bool is_qoi = false;
+    static bool is_current_layer_only = false;
 
     ImGui::OpenPopup("Save");
 
@@ -283,6 +298,36 @@ void UI::RenderSaveAsImagePopup()
                          file_name_str.size());
         ImGui::Text("Magnify factor:");
         ImGui::InputInt("##mag_input", &magnify_factor);
+        ImGui::Text("Format:");
+
+        if (ImGui::RadioButton("PNG", !is_qoi)) { is_qoi = false; }
+
+        ImGui::SameLine();
+
+        if (ImGui::RadioButton("QOI", is_qoi)) { is_qoi = true; }
+
+        if (is_qoi)
+        {
+            ImGui::Checkbox("Only the current layer", &is_current_layer_only);
+        }
+        else
+        {
+            ImGui::Text("Encoder:");
+
+            if (ImGui::RadioButton("Fast",
+                                   encoder == Project::PngEncoder::kFast))
+            {
+                encoder = Project::PngEncoder::kFast;
+            }
+
+            ImGui::SameLine();
+
+            if (ImGui::RadioButton("stb (compatible)",
+                                   encoder == Project::PngEncoder::kStb))
+            {
+                encoder = Project::PngEncoder::kStb;
+            }
+        }
 
         if (ImGui::Button("Save"))
         {
@@ -290,9 +335,25 @@ void UI::RenderSaveAsImagePopup()
             destination += '/';
             destination += file_name_str.data();
 
-            if (!mProject.get().SaveAsImage(magnify_factor, destination))
+            const auto report =
+                is_qoi ? mProject.get().SaveAsQoi(
+                             magnify_factor, destination,
+                             is_current_layer_only
+                                 ? std::optional{layers.GetCurrentLayerIndex()}
+                                 : std::nullopt)
+                       : mProject.get().SaveAsImage(magnify_factor,
+                                                    destination, encoder);
+
+            if (report.has_value())
             {
-                TriggerSaveErrorPopup();
+                mExportReport = *report;
+                mRenderExportReportPopup = true;
+            }
+            else
+            {
+                TriggerSaveErrorPopup(
+                    "Failed to save the picture. Check your destination, "
+                    "picture name and magnify factor");
             }
 
             mRenderSaveAsImgPopup = false;
@@ -515,6 +576,43 @@ void UI::RenderUndoTreeWindow(Layers& layers)
     ImGui::Begin("Undo Tree", &mRenderUndoTreeWindow, ImGuiWindowFlags_None);
     mShouldDoTool = false;
 
+    constexpr float kBytesInMiB = 1024.0F * 1024.0F;
+    constexpr int kMinBudgetMiB = 16;
+    constexpr int kMaxBudgetMiB = 8192;
+
+    ImGui::Text("Memory used: %.1f MiB",
+                static_cast<float>(layers.GetHistoryByteSize()) / kBytesInMiB);
+
+    int budget_mib = static_cast<int>(
+        static_cast<float>(layers.GetHistoryBudget()) / kBytesInMiB);
+    if (ImGui::SliderInt("Budget (MiB)", &budget_mib, kMinBudgetMiB,
+                         kMaxBudgetMiB))
+    {
+        layers.SetHistoryBudget(static_cast<std::size_t>(budget_mib) * 1024 *
+                                1024);
+    }
+
+    bool spill_to_disk = layers.IsHistoryJournalEnabled();
+    if (ImGui::Checkbox("Spill history to disk", &spill_to_disk))
+    {
+        // If the journal can't be created, the box just stays unchecked. If
+        // it can't be read back, it stays checked.
+        if (spill_to_disk)
+        {
+            layers.EnableHistoryJournal(mProject.get().GetHistoryJournalPath());
+        }
+        else { layers.DisableHistoryJournal(); }
+    }
+
+    if (layers.IsHistoryJournalEnabled())
+    {
+        ImGui::Text("On disk: %.1f MiB",
+                    static_cast<float>(layers.GetHistoryJournalSize()) /
+                        kBytesInMiB);
+    }
+
+    ImGui::Separator();
+
     mRenderNodesChildrenFuncData.Reset();
     RenderNodesChildren(layers, layers.GetUndoTree());
 
@@ -658,7 +756,10 @@ void UI::RenderLayerWindow(Layers& layers)
         ImGui::PushItemWidth(100.0F);
         ImGui::PushID(static_cast<int>(i));
 
-        if (ImGui::SliderInt("Opacity", &layer_traversed.mOpacity, 0, 255)) {}
+        if (ImGui::SliderInt("Opacity", &layer_traversed.mOpacity, 0, 255))
+        {
+            layer_traversed.InvalidateComposite();
+        }
 
         ImGui::PopID();
         ImGui::PopItemWidth();
@@ -753,8 +854,7 @@ void UI::RenderSaveErrorPopup()
     if (ImGui::BeginPopupModal("Error: Failed to save", nullptr,
                                ImGuiWindowFlags_AlwaysAutoResize))
     {
-        ImGui::Text("Failed to save the picture. Check your destination, "
-                    "picture name and magnify factor");
+        ImGui::TextUnformatted(mSaveErrorMessage.c_str());
 
         if (ImGui::Button("OK"))
         {
@@ -766,6 +866,62 @@ void UI::RenderSaveErrorPopup()
     }
 }
 
+void UI::RenderExportReportPopup()
+{
+    mShouldDoTool = false; // Don't want to draw with a popup opened
+
+    ImGui::OpenPopup("Picture saved");
+
+    if (ImGui::BeginPopupModal("Picture saved", nullptr,
+                               ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        constexpr double kBytesPerKiB = 1024.0;
+        constexpr double kMsPerSecond = 1000.0;
+        ImGui::Text("Wrote %.1f KiB in %.1f ms",
+                    static_cast<double>(mExportReport.byte_size) /
+                        kBytesPerKiB,
+                    mExportReport.encode_seconds * kMsPerSecond);
+
+        if (mExportReport.palette_size != 0)
+        {
+            ImGui::Text("8-bit indexed, %zu colors",
+                        mExportReport.palette_size);
+        }
+        else { ImGui::Text("32-bit RGBA"); }
+
+        if (ImGui::Button("OK"))
+        {
+            mRenderExportReportPopup = false;
+            ImGui::CloseCurrentPopup();
+        }
+
+        ImGui::EndPopup();
+    }
+}
+
+void UI::RenderSaveProgress()
+{
+    auto& project = mProject.get();
+
+    if (project.IsSaving())
+    {
+        ImGui::Begin("Saving", nullptr,
+                     ImGuiWindowFlags_AlwaysAutoResize |
+                         ImGuiWindowFlags_NoCollapse);
+        ImGui::ProgressBar(project.GetSaveProgress());
+        ImGui::End();
+        return;
+    }
+
+    const auto save_result = project.TakeSaveResult();
+
+    if (save_result.has_value() && !*save_result)
+    {
+        TriggerSaveErrorPopup("Failed to save the project. Check your "
+                              "destination and file name");
+    }
+}
+
 void UI::RenderNewProjectPopup()
 {
     mShouldDoTool = false;
@@ -9,6 +9,8 @@
 
 #include <array>
 #include <span>
+#include <string>
+#include <utility>
 
 namespace Pikzel
 {
@@ -48,7 +50,11 @@ class UI
         return GetCanvasBottomRightCoordsRef();
     }
 
-    void TriggerSaveErrorPopup() { mRenderSaveErrorPopup = true; }
+    void TriggerSaveErrorPopup(std::string message)
+    {
+        mSaveErrorMessage = std::move(message);
+        mRenderSaveErrorPopup = true;
+    }
 
     [[nodiscard]] static auto GetWindowPointer() -> GLFWwindow*
     {
@@ -70,7 +76,7 @@ class UI
     };
 
     void RenderMenuBar(Layers& layers, Camera& camera);
-    void RenderSaveAsImagePopup();
+    void RenderSaveAsImagePopup(const Layers& layers);
     void RenderSaveAsProjectPopup();
     void RenderNodesChildren(Layers& layers, Tree<Layers::Capture>& node);
     void RenderUndoTreeWindow(Layers& layers);
@@ -78,6 +84,11 @@ class UI
     void RenderLayerWindow(Layers& layers);
     void RenderLayerWinContextMenu(Layers& layers);
     void RenderSaveErrorPopup();
+    // How long the last picture export took and how big it is
+    void RenderExportReportPopup();
+    // Progress of a project save running in the background, and the error
+    // popup if it failed
+    void RenderSaveProgress();
     void RenderNewProjectPopup();
     void RenderOpenProjectPopup();
 
@@ -116,6 +127,8 @@ class UI
     ImTextureID mLockLockedTextureID{0};
     ImTextureID mLockUnlockedTextureID{0};
 
+    std::string mSaveErrorMessage;
+    Project::ImageExportReport mExportReport;
     ImVec2 mDrawWinDimensions;
     ImVec4 mSelectedItemOutlineColor;
 
@@ -123,6 +136,7 @@ class UI
     bool mRenderSaveAsImgPopup{false};
     bool mRenderSaveAsPrjPopup{false};
     bool mRenderSaveErrorPopup{false};
+    bool mRenderExportReportPopup{false};
     bool mRenderNewProjectPopup{false};
     bool mRenderOpenProjectPopup{false};
     bool mRenderUndoTreeWindow{false};
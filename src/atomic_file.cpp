@@ -0,0 +1,104 @@
+#include "atomic_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace Pikzel
+{
+namespace
+{
+// Makes sure the contents are on the disk, not only in the OS cache
+auto SyncFile(const std::string& path) -> bool
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE) { return false; }
+
+    const bool is_synced = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return is_synced;
+#else
+    const int file = open(path.c_str(), O_WRONLY);
+    if (file == -1) { return false; }
+
+    const bool is_synced = fsync(file) == 0;
+    close(file);
+    return is_synced;
+#endif
+}
+
+// The rename itself is only durable once the directory is synced. Windows
+// has no such thing.
+void SyncDirectory([[maybe_unused]] const std::filesystem::path& dir)
+{
+#ifndef _WIN32
+    const int dir_fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (dir_fd == -1) { return; }
+
+    fsync(dir_fd);
+    close(dir_fd);
+#endif
+}
+} // namespace
+
+auto WriteFileAtomically(const std::string& path,
+                         const std::function<bool(std::ostream&)>& write)
+    -> bool
+{
+    const std::string temp_path = path + ".tmp";
+    std::error_code error;
+
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+
+        if (!file.is_open())
+        {
+#ifndef NDEBUG
+            std::cerr << "Couldn't create " << temp_path
+                      << " in WriteFileAtomically\n";
+#endif
+            return false;
+        }
+
+        if (!write(file) || !file.flush())
+        {
+            file.close();
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+    }
+
+    if (!SyncFile(temp_path))
+    {
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+
+    std::filesystem::rename(temp_path, path, error);
+
+    if (error)
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't replace " << path << " in WriteFileAtomically: "
+                  << error.message() << '\n';
+#endif
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+
+    SyncDirectory(std::filesystem::path{path}.parent_path());
+    return true;
+}
+} // namespace Pikzel
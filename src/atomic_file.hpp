@@ -0,0 +1,16 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace Pikzel
+{
+// Writes the file through 'write' into a temporary one next to 'path',
+// flushes it to the disk and renames it over 'path'. A crash at any point
+// leaves either the old file or the complete new one. 'write' returns false
+// to abort, which leaves the old file as it was.
+auto WriteFileAtomically(const std::string& path,
+                         const std::function<bool(std::ostream&)>& write)
+    -> bool;
+} // namespace Pikzel
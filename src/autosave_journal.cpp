@@ -0,0 +1,767 @@
+#include "autosave_journal.hpp"
+#include "atomic_file.hpp"
+#include "byte_io.hpp"
+#include "layer.hpp"
+#include "mapped_file.hpp"
+#include "pkz_format.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace Pikzel
+{
+namespace
+{
+constexpr std::array<std::byte, 4> kMagic = {std::byte{'P'}, std::byte{'K'},
+                                             std::byte{'Z'}, std::byte{'A'}};
+constexpr uint32_t kVersion = 1;
+
+using ByteIo::Reader;
+
+// FNV-1a
+auto Checksum(std::span<const std::byte> data) -> uint32_t
+{
+    uint32_t hash = 2166136261U;
+
+    for (const auto byte : data)
+    {
+        hash ^= static_cast<uint32_t>(byte);
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+struct FileStamp
+{
+    uint64_t size;
+    int64_t write_time;
+};
+
+// Tells if a file was written to since
+auto GetFileStamp(const std::string& path) -> std::optional<FileStamp>
+{
+    std::error_code error;
+    const auto size = std::filesystem::file_size(path, error);
+
+    if (error) { return std::nullopt; }
+
+    const auto write_time = std::filesystem::last_write_time(path, error);
+
+    if (error) { return std::nullopt; }
+
+    return FileStamp{
+        .size = static_cast<uint64_t>(size),
+        .write_time =
+            static_cast<int64_t>(write_time.time_since_epoch().count())};
+}
+
+void AppendDims(Vec2Int canvas_dims, std::vector<std::byte>& dst)
+{
+    ByteIo::Append(static_cast<uint32_t>(canvas_dims.x), dst);
+    ByteIo::Append(static_cast<uint32_t>(canvas_dims.y), dst);
+}
+
+// A tile as it was when snapshotted, copy on write keeps it that way
+struct TileSnapshot
+{
+    uint64_t layer_id;
+    std::size_t tile_index;
+    TiledCanvas::TileHandle handle;
+};
+
+// Tiles of layers which are gone are skipped. Those still in the project
+// file get loaded.
+auto SnapshotTiles(const std::list<Layer>& layers,
+                   std::span<const Layers::ChangedTile> tiles)
+    -> std::vector<TileSnapshot>
+{
+    std::vector<TileSnapshot> snapshot;
+    snapshot.reserve(tiles.size());
+
+    for (const auto& tile : tiles)
+    {
+        auto iter = std::ranges::find(layers, tile.layer_id, &Layer::GetId);
+
+        if (iter == layers.end()) { continue; }
+
+        snapshot.push_back(
+            {.layer_id = static_cast<uint64_t>(tile.layer_id),
+             .tile_index = tile.tile_index,
+             .handle = iter->GetCanvas().GetTileHandle(tile.tile_index)});
+    }
+
+    return snapshot;
+}
+
+// The tiles which aren't empty, of every layer
+auto GetNonEmptyTiles(const std::list<Layer>& layers)
+    -> std::vector<Layers::ChangedTile>
+{
+    std::vector<Layers::ChangedTile> tiles;
+
+    for (const auto& layer : layers)
+    {
+        const auto& canvas = layer.GetCanvas();
+
+        for (std::size_t i = 0; i < canvas.GetTileCount(); i++)
+        {
+            if (canvas.IsTileEmpty(i)) { continue; }
+
+            tiles.push_back({.layer_id = layer.GetId(), .tile_index = i});
+        }
+    }
+
+    return tiles;
+}
+
+// Encodes the tiles in parallel and appends them to 'dst'
+void AppendTiles(std::span<const TileSnapshot> tiles,
+                 std::vector<std::byte>& dst)
+{
+    struct EncodedTile
+    {
+        Pkz::ChunkCodec codec = Pkz::ChunkCodec::kEmpty;
+        std::vector<std::byte> data;
+    };
+
+    std::vector<EncodedTile> encoded(tiles.size());
+
+    ThreadPool::Get().ParallelFor(
+        tiles.size(),
+        [&](std::size_t index)
+        {
+            const auto& handle = tiles[index].handle;
+
+            if (handle == TiledCanvas::GetEmptyTile()) { return; }
+
+            encoded[index].codec =
+                Pkz::EncodeChunk(*handle, encoded[index].data);
+        });
+
+    ByteIo::Append(static_cast<uint32_t>(tiles.size()), dst);
+
+    for (std::size_t i = 0; i < tiles.size(); i++)
+    {
+        ByteIo::Append(tiles[i].layer_id, dst);
+        ByteIo::Append(static_cast<uint32_t>(tiles[i].tile_index), dst);
+        ByteIo::Append(static_cast<uint32_t>(encoded[i].codec), dst);
+        ByteIo::Append(static_cast<uint32_t>(encoded[i].data.size()), dst);
+        dst.insert(dst.end(), encoded[i].data.begin(), encoded[i].data.end());
+    }
+}
+
+// Makes the layers of 'recovered' the ones listed. Those already there keep
+// their tiles, new ones start empty.
+auto ReadLayers(Reader& reader, std::size_t tile_count,
+                AutosaveJournal::Recovered& recovered) -> bool
+{
+    const auto layer_count = reader.Read<uint32_t>();
+
+    if (reader.HasFailed() || layer_count == 0) { return false; }
+
+    std::vector<AutosaveJournal::RecoveredLayer> layers;
+
+    for (uint32_t i = 0; i < layer_count; i++)
+    {
+        const auto id = reader.Read<uint64_t>();
+        const auto opacity = reader.Read<uint32_t>();
+
+        if (reader.HasFailed()) { return false; }
+
+        auto iter = std::ranges::find(recovered.layers, id,
+                                      &AutosaveJournal::RecoveredLayer::id);
+
+        if (iter != recovered.layers.end())
+        {
+            layers.push_back(std::move(*iter));
+            recovered.layers.erase(iter);
+        }
+        else
+        {
+            layers.push_back(
+                {.id = id,
+                 .opacity = 0,
+                 .tiles = std::vector<TiledCanvas::TileHandle>(
+                     tile_count, TiledCanvas::GetEmptyTile())});
+        }
+
+        layers.back().opacity = opacity;
+    }
+
+    recovered.layers = std::move(layers);
+    return true;
+}
+
+auto ReadTiles(Reader& reader, AutosaveJournal::Recovered& recovered) -> bool
+{
+    const auto tile_count = reader.Read<uint32_t>();
+
+    for (uint32_t i = 0; i < tile_count && !reader.HasFailed(); i++)
+    {
+        const auto layer_id = reader.Read<uint64_t>();
+        const auto tile_index = reader.Read<uint32_t>();
+        const auto codec =
+            static_cast<Pkz::ChunkCodec>(reader.Read<uint32_t>());
+        const auto data = reader.ReadBytes(reader.Read<uint32_t>());
+
+        auto layer = std::ranges::find(recovered.layers, layer_id,
+                                       &AutosaveJournal::RecoveredLayer::id);
+
+        if (reader.HasFailed() || layer == recovered.layers.end() ||
+            tile_index >= layer->tiles.size())
+        {
+            return false;
+        }
+
+        if (codec == Pkz::ChunkCodec::kEmpty && data.empty())
+        {
+            layer->tiles[tile_index] = TiledCanvas::GetEmptyTile();
+            continue;
+        }
+
+        auto tile = std::make_shared<TiledCanvas::Tile>();
+
+        if (!Pkz::DecodeChunk(data, codec, *tile)) { return false; }
+
+        layer->tiles[tile_index] = std::move(tile);
+    }
+
+    return !reader.HasFailed() && reader.IsAtEnd();
+}
+
+// Decodes all the tiles of the project file the record refers to, if it
+// wasn't written to since
+auto ReadProjectFile(Reader& reader, AutosaveJournal::Recovered& recovered)
+    -> bool
+{
+    const auto size = reader.Read<uint64_t>();
+    const auto write_time = reader.Read<int64_t>();
+    const auto path_bytes = reader.ReadBytes(reader.Read<uint32_t>());
+
+    if (reader.HasFailed() || !reader.IsAtEnd()) { return false; }
+
+    const std::string project_path{
+        reinterpret_cast<const char*>(path_bytes.data()), path_bytes.size()};
+    const auto stamp = GetFileStamp(project_path);
+
+    if (!stamp.has_value() || stamp->size != size ||
+        stamp->write_time != write_time)
+    {
+#ifndef NDEBUG
+        std::cerr << "The autosave of " << project_path
+                  << " is older than the file\n";
+#endif
+        return false;
+    }
+
+    MappedFile file;
+
+    if (!file.Map(project_path)) { return false; }
+
+    const auto tables = Pkz::ParseTables(file.GetData());
+
+    if (!tables.has_value() ||
+        tables->layers.size() != recovered.layers.size() ||
+        std::cmp_not_equal(tables->width, recovered.canvas_dims.x) ||
+        std::cmp_not_equal(tables->height, recovered.canvas_dims.y))
+    {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < tables->layers.size(); i++)
+    {
+        const auto& chunks = tables->layers[i].chunks;
+        auto& tiles = recovered.layers[i].tiles;
+
+        for (std::size_t j = 0; j < chunks.size(); j++)
+        {
+            if (chunks[j].codec == Pkz::ChunkCodec::kEmpty) { continue; }
+
+            auto tile = std::make_shared<TiledCanvas::Tile>();
+
+            if (!Pkz::DecodeChunk(
+                    file.GetData().subspan(chunks[j].offset, chunks[j].size),
+                    chunks[j].codec, *tile))
+            {
+                return false;
+            }
+
+            tiles[j] = std::move(tile);
+        }
+    }
+
+    return true;
+}
+} // namespace
+
+auto AutosaveJournal::Start(const std::string& path, Vec2Int canvas_dims,
+                            const std::list<Layer>& layers) -> bool
+{
+    const auto tiles = SnapshotTiles(layers, GetNonEmptyTiles(layers));
+    auto states = GetLayerStates(layers);
+    std::vector<std::byte> payload;
+    AppendDims(canvas_dims, payload);
+    AppendLayerStates(states, payload);
+    AppendTiles(tiles, payload);
+
+    // A new project, nothing to lose
+    const bool has_edits = !tiles.empty() || states.size() > 1;
+
+    if (!StartWith(path, canvas_dims, std::move(states),
+                   RecordType::kSnapshot, payload))
+    {
+        return false;
+    }
+
+    mHasEdits = has_edits;
+    return true;
+}
+
+auto AutosaveJournal::StartFromProjectFile(const std::string& path,
+                                           const std::string& project_path,
+                                           Vec2Int canvas_dims,
+                                           const std::list<Layer>& layers)
+    -> bool
+{
+    if (!StartFromProjectFile(path, project_path, canvas_dims,
+                              GetLayerStates(layers)))
+    {
+        return Start(path, canvas_dims, layers);
+    }
+
+    return true;
+}
+
+auto AutosaveJournal::StartFromProjectFile(const std::string& path,
+                                           const std::string& project_path,
+                                           Vec2Int canvas_dims,
+                                           std::vector<LayerState> states)
+    -> bool
+{
+    const auto stamp = GetFileStamp(project_path);
+
+    if (!stamp.has_value()) { return false; }
+
+    std::vector<std::byte> payload;
+    AppendDims(canvas_dims, payload);
+    AppendLayerStates(states, payload);
+    ByteIo::Append(stamp->size, payload);
+    ByteIo::Append(stamp->write_time, payload);
+    ByteIo::Append(static_cast<uint32_t>(project_path.size()), payload);
+    const auto path_bytes = std::as_bytes(std::span{project_path});
+    payload.insert(payload.end(), path_bytes.begin(), path_bytes.end());
+
+    if (!StartWith(path, canvas_dims, std::move(states),
+                   RecordType::kProjectFile, payload))
+    {
+        return false;
+    }
+
+    mProjectFilePayload = std::move(payload);
+    mHasEdits = false;
+    return true;
+}
+
+AutosaveJournal::~AutosaveJournal()
+{
+    CancelCompaction();
+}
+
+void AutosaveJournal::Stop()
+{
+    CancelCompaction();
+    mFile.close();
+
+    if (!mPath.empty())
+    {
+        std::error_code error;
+        std::filesystem::remove(mPath, error);
+    }
+
+    mPath.clear();
+    mLastLayerStates.clear();
+    mSavedLayerStates.reset();
+    mTilesChangedWhileSaving.clear();
+    mProjectFilePayload.reset();
+    mTilesChangedSinceProjectFile.clear();
+    mHasEdits = false;
+}
+
+void AutosaveJournal::Append(const std::list<Layer>& layers,
+                             std::span<const Layers::ChangedTile> changed_tiles)
+{
+    if (!IsStarted()) { return; }
+
+    FinishCompaction();
+
+    if (IsSavePending())
+    {
+        mTilesChangedWhileSaving.insert(mTilesChangedWhileSaving.end(),
+                                        changed_tiles.begin(),
+                                        changed_tiles.end());
+    }
+
+    auto states = GetLayerStates(layers);
+
+    if (changed_tiles.empty() && states == mLastLayerStates) { return; }
+
+    if (mProjectFilePayload.has_value() && !changed_tiles.empty())
+    {
+        auto& tiles = mTilesChangedSinceProjectFile;
+        tiles.insert(tiles.end(), changed_tiles.begin(), changed_tiles.end());
+        std::ranges::sort(tiles);
+        const auto duplicates = std::ranges::unique(tiles);
+        tiles.erase(duplicates.begin(), duplicates.end());
+    }
+
+    std::vector<std::byte> payload;
+    AppendLayerStates(states, payload);
+    AppendTiles(SnapshotTiles(layers, changed_tiles), payload);
+
+    std::vector<std::byte> record;
+    AppendRecord(RecordType::kDelta, payload, record);
+
+    mFile.write(reinterpret_cast<const char*>(record.data()),
+                static_cast<std::streamsize>(record.size()));
+    mFile.flush();
+
+    if (!mFile)
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't append to the autosave journal: " << mPath
+                  << "\nFile: " << __FILE__ << "\nLine: " << __LINE__ << '\n';
+#endif
+        // What's before this record can still be recovered
+        CancelCompaction();
+        mFile.close();
+        return;
+    }
+
+    if (mCompaction.has_value())
+    {
+        mCompaction->records.insert(mCompaction->records.end(),
+                                    record.begin(), record.end());
+    }
+
+    mLastLayerStates = std::move(states);
+    mDeltaSize += record.size();
+    mHasEdits = true;
+
+    if (!mCompaction.has_value() &&
+        mDeltaSize > std::max(mSnapshotSize, kMinCompactionSize))
+    {
+        BeginCompaction(layers);
+    }
+}
+
+void AutosaveJournal::BeginSave(const std::list<Layer>& layers)
+{
+    if (!IsStarted()) { return; }
+
+    mSavedLayerStates = GetLayerStates(layers);
+    mTilesChangedWhileSaving.clear();
+}
+
+void AutosaveJournal::EndSave(const std::string& path,
+                              const std::string& project_path,
+                              const std::list<Layer>& layers,
+                              bool has_succeeded)
+{
+    if (!IsSavePending()) { return; }
+
+    auto saved_layer_states = std::move(*mSavedLayerStates);
+    mSavedLayerStates.reset();
+    auto changed_tiles = std::exchange(mTilesChangedWhileSaving, {});
+
+    // Otherwise it just carries on
+    if (!has_succeeded) { return; }
+
+    if (!StartFromProjectFile(path, project_path, mCanvasDims,
+                              std::move(saved_layer_states)))
+    {
+        (void)Start(path, mCanvasDims, layers);
+        return;
+    }
+
+    std::ranges::sort(changed_tiles);
+    const auto duplicates = std::ranges::unique(changed_tiles);
+    changed_tiles.erase(duplicates.begin(), duplicates.end());
+    Append(layers, changed_tiles);
+}
+
+auto AutosaveJournal::Recover(const std::string& path)
+    -> std::optional<Recovered>
+{
+    MappedFile file;
+
+    if (!file.Map(path)) { return std::nullopt; }
+
+    Reader reader{file.GetData()};
+
+    if (!std::ranges::equal(reader.ReadBytes(kMagic.size()), kMagic) ||
+        reader.Read<uint32_t>() != kVersion || reader.HasFailed())
+    {
+        return std::nullopt;
+    }
+
+    std::optional<Recovered> recovered;
+    std::size_t tile_count = 0;
+
+    while (!reader.IsAtEnd())
+    {
+        const auto type = static_cast<RecordType>(reader.Read<uint32_t>());
+        const auto size = reader.Read<uint32_t>();
+        const auto checksum = reader.Read<uint32_t>();
+        const auto payload = reader.ReadBytes(size);
+
+        // Torn by a crash while it was appended
+        if (reader.HasFailed() || Checksum(payload) != checksum) { break; }
+
+        Reader payload_reader{payload};
+        // Left as it was if the record turns out invalid
+        auto next = recovered;
+
+        if (type == RecordType::kSnapshot || type == RecordType::kProjectFile)
+        {
+            const auto width = payload_reader.Read<uint32_t>();
+            const auto height = payload_reader.Read<uint32_t>();
+
+            if (payload_reader.HasFailed() || width == 0 || height == 0)
+            {
+                break;
+            }
+
+            next.emplace();
+            next->canvas_dims = {static_cast<int>(width),
+                                 static_cast<int>(height)};
+            tile_count = TiledCanvas{next->canvas_dims}.GetTileCount();
+        }
+        else if (type != RecordType::kDelta || !next.has_value()) { break; }
+
+        if (!ReadLayers(payload_reader, tile_count, *next)) { break; }
+
+        const bool is_valid = type == RecordType::kProjectFile
+                                  ? ReadProjectFile(payload_reader, *next)
+                                  : ReadTiles(payload_reader, *next);
+
+        if (!is_valid) { break; }
+
+        recovered = std::move(next);
+    }
+
+#ifndef NDEBUG
+    if (!reader.IsAtEnd())
+    {
+        std::cerr << "The autosave journal " << path
+                  << " ends with an invalid record, it's ignored\n";
+    }
+#endif
+
+    return recovered;
+}
+
+auto AutosaveJournal::StartWith(const std::string& path, Vec2Int canvas_dims,
+                                std::vector<LayerState> states,
+                                RecordType type,
+                                std::span<const std::byte> payload) -> bool
+{
+    CancelCompaction();
+    mFile.close();
+    mProjectFilePayload.reset();
+    mTilesChangedSinceProjectFile.clear();
+
+    if (!mPath.empty() && mPath != path)
+    {
+        std::error_code error;
+        std::filesystem::remove(mPath, error);
+    }
+
+    mPath = path;
+    mCanvasDims = canvas_dims;
+
+    std::vector<std::byte> data{kMagic.begin(), kMagic.end()};
+    ByteIo::Append(kVersion, data);
+    AppendRecord(type, payload, data);
+
+    const bool has_written = WriteFileAtomically(
+        path,
+        [&](std::ostream& out)
+        {
+            out.write(reinterpret_cast<const char*>(data.data()),
+                      static_cast<std::streamsize>(data.size()));
+            return static_cast<bool>(out);
+        });
+
+    if (has_written)
+    {
+        mFile.open(path, std::ios::binary | std::ios::app);
+    }
+
+    if (!mFile.is_open())
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't start the autosave journal: " << path
+                  << "\nFile: " << __FILE__ << "\nLine: " << __LINE__ << '\n';
+#endif
+        return false;
+    }
+
+    mLastLayerStates = std::move(states);
+    mSnapshotSize = data.size();
+    mDeltaSize = 0;
+    return true;
+}
+
+void AutosaveJournal::BeginCompaction(const std::list<Layer>& layers)
+{
+    std::vector<std::byte> data{kMagic.begin(), kMagic.end()};
+    ByteIo::Append(kVersion, data);
+    std::vector<std::byte> payload;
+    std::vector<TileSnapshot> tiles;
+    auto type = RecordType::kSnapshot;
+
+    if (mProjectFilePayload.has_value())
+    {
+        // The tiles which aren't in the project file anymore are enough
+        AppendRecord(RecordType::kProjectFile, *mProjectFilePayload, data);
+        tiles = SnapshotTiles(layers, mTilesChangedSinceProjectFile);
+        type = RecordType::kDelta;
+    }
+    else
+    {
+        AppendDims(mCanvasDims, payload);
+        tiles = SnapshotTiles(layers, GetNonEmptyTiles(layers));
+    }
+
+    AppendLayerStates(mLastLayerStates, payload);
+
+    auto result = std::make_shared<CompactionResult>();
+    auto path = mPath + ".compacting";
+    auto done = ThreadPool::Get().Submit(
+        [result, path, data = std::move(data), payload = std::move(payload),
+         tiles = std::move(tiles), type]() mutable
+        {
+            AppendTiles(tiles, payload);
+            AppendRecord(type, payload, data);
+
+            result->has_succeeded = WriteFileAtomically(
+                path,
+                [&](std::ostream& out)
+                {
+                    out.write(reinterpret_cast<const char*>(data.data()),
+                              static_cast<std::streamsize>(data.size()));
+                    return static_cast<bool>(out);
+                });
+            result->snapshot_size = data.size();
+        });
+
+    mCompaction = Compaction{.path = std::move(path),
+                             .result = std::move(result),
+                             .done = std::move(done),
+                             .records = {}};
+}
+
+void AutosaveJournal::FinishCompaction()
+{
+    if (!mCompaction.has_value() ||
+        mCompaction->done.wait_for(std::chrono::seconds{0}) !=
+            std::future_status::ready)
+    {
+        return;
+    }
+
+    auto compaction = std::move(*mCompaction);
+    mCompaction.reset();
+    std::error_code error;
+    bool has_swapped = false;
+
+    if (compaction.result->has_succeeded)
+    {
+        // The deltas appended meanwhile follow the compacted records
+        std::ofstream file{compaction.path, std::ios::binary | std::ios::app};
+        file.write(reinterpret_cast<const char*>(compaction.records.data()),
+                   static_cast<std::streamsize>(compaction.records.size()));
+        file.flush();
+
+        if (file)
+        {
+            file.close();
+            mFile.close();
+            std::filesystem::rename(compaction.path, mPath, error);
+            has_swapped = !error;
+            mFile.open(mPath, std::ios::binary | std::ios::app);
+        }
+    }
+
+    if (!has_swapped)
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't compact the autosave journal: " << mPath
+                  << "\nFile: " << __FILE__ << "\nLine: " << __LINE__ << '\n';
+#endif
+        std::filesystem::remove(compaction.path, error);
+        // Tries again once the deltas doubled
+        mSnapshotSize = mDeltaSize * 2;
+        return;
+    }
+
+    mSnapshotSize = compaction.result->snapshot_size;
+    mDeltaSize = compaction.records.size();
+}
+
+void AutosaveJournal::CancelCompaction()
+{
+    if (!mCompaction.has_value()) { return; }
+
+    mCompaction->done.wait();
+    std::error_code error;
+    std::filesystem::remove(mCompaction->path, error);
+    mCompaction.reset();
+}
+
+auto AutosaveJournal::GetLayerStates(const std::list<Layer>& layers)
+    -> std::vector<LayerState>
+{
+    std::vector<LayerState> states;
+    states.reserve(layers.size());
+
+    for (const auto& layer : layers)
+    {
+        states.push_back(
+            {.id = static_cast<uint64_t>(layer.GetId()),
+             .opacity = static_cast<uint32_t>(layer.GetOpacity())});
+    }
+
+    return states;
+}
+
+void AutosaveJournal::AppendLayerStates(const std::vector<LayerState>& states,
+                                        std::vector<std::byte>& dst)
+{
+    ByteIo::Append(static_cast<uint32_t>(states.size()), dst);
+
+    for (const auto& state : states)
+    {
+        ByteIo::Append(state.id, dst);
+        ByteIo::Append(state.opacity, dst);
+    }
+}
+
+void AutosaveJournal::AppendRecord(RecordType type,
+                                   std::span<const std::byte> payload,
+                                   std::vector<std::byte>& dst)
+{
+    ByteIo::Append(static_cast<uint32_t>(type), dst);
+    ByteIo::Append(static_cast<uint32_t>(payload.size()), dst);
+    ByteIo::Append(Checksum(payload), dst);
+    dst.insert(dst.end(), payload.begin(), payload.end());
+}
+} // namespace Pikzel
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "layer_control.hpp"
+#include "tiled_canvas.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <list>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Pikzel
+{
+class Layer;
+
+// Keeps the document recoverable after a crash. It starts with a snapshot
+// of every layer, then every committed edit appends only the tiles it
+// changed. Once those outgrow the snapshot, the file is compacted into a new
+// snapshot.
+//
+// All the numbers are little endian:
+//     header   magic, version
+//     records  type, payload size, checksum of the payload, payload
+// Every record starts with the layers, by id and with their opacity, in the
+// order of the document. A snapshot has the canvas dims before them and all
+// the tiles which aren't empty after them. A project file record stands for
+// a snapshot of the project file it names, as long as the file keeps its
+// size and its time of modification. A delta has the tiles changed since the
+// record before. A crash while appending leaves a torn last record, which
+// fails its checksum and is ignored.
+//
+// Compacting is done on the thread pool, into a file next to the journal.
+// A journal which started from a project file keeps that record, followed by
+// one delta with every tile changed since. Deltas keep going to the old file
+// meanwhile, and are copied after the compacted one before it replaces it.
+class AutosaveJournal
+{
+  public:
+    struct RecoveredLayer
+    {
+        uint64_t id = 0;
+        uint32_t opacity = 0;
+        std::vector<TiledCanvas::TileHandle> tiles;
+    };
+
+    struct Recovered
+    {
+        Vec2Int canvas_dims{0, 0};
+        std::vector<RecoveredLayer> layers;
+    };
+
+    AutosaveJournal() = default;
+    AutosaveJournal(const AutosaveJournal&) = delete;
+    AutosaveJournal(AutosaveJournal&&) = delete;
+    auto operator=(const AutosaveJournal&) -> AutosaveJournal& = delete;
+    auto operator=(AutosaveJournal&&) -> AutosaveJournal& = delete;
+    // Leaves the file, so what's in it can still be recovered. Waits for the
+    // compaction, if one is running, and drops it.
+    ~AutosaveJournal();
+
+    // Replaces the file at 'path' with a snapshot of 'layers'. Stops the
+    // journal started before, if any.
+    auto Start(const std::string& path, Vec2Int canvas_dims,
+               const std::list<Layer>& layers) -> bool;
+    // Same, for layers just opened from or saved to 'project_path'. Only
+    // refers to that file, so none of the tiles have to be loaded.
+    auto StartFromProjectFile(const std::string& path,
+                              const std::string& project_path,
+                              Vec2Int canvas_dims,
+                              const std::list<Layer>& layers) -> bool;
+    // Deletes the file, there's nothing to recover anymore
+    void Stop();
+    // Writes the changed tiles, or only the layers if those changed. The
+    // data is flushed to the OS, but not synced to the disk. Call every
+    // frame, it also swaps in the compacted file once it's written.
+    void Append(const std::list<Layer>& layers,
+                std::span<const Layers::ChangedTile> changed_tiles);
+    // Call as the layers get snapshotted to be saved. The tiles changed
+    // until EndSave are kept track of.
+    void BeginSave(const std::list<Layer>& layers);
+    // Once the save succeeded the journal starts over from the saved file,
+    // at 'path', with the edits made while it was written
+    void EndSave(const std::string& path, const std::string& project_path,
+                 const std::list<Layer>& layers, bool has_succeeded);
+
+    [[nodiscard]] auto IsStarted() const -> bool { return mFile.is_open(); }
+    [[nodiscard]] auto IsSavePending() const -> bool
+    {
+        return mSavedLayerStates.has_value();
+    }
+    // Whether the file holds anything which isn't in a project file
+    [[nodiscard]] auto HasEdits() const -> bool { return mHasEdits; }
+    [[nodiscard]] auto GetPath() const -> const std::string& { return mPath; }
+
+    // Replays the file up to its last intact record
+    [[nodiscard]] static auto Recover(const std::string& path)
+        -> std::optional<Recovered>;
+
+  private:
+    struct LayerState
+    {
+        uint64_t id;
+        uint32_t opacity;
+
+        auto operator==(const LayerState&) const -> bool = default;
+    };
+
+    enum class RecordType : uint32_t
+    {
+        kSnapshot = 1,
+        kDelta = 2,
+        kProjectFile = 3,
+    };
+
+    // Written by a worker, read once its future is ready
+    struct CompactionResult
+    {
+        bool has_succeeded = false;
+        std::size_t snapshot_size = 0;
+    };
+
+    struct Compaction
+    {
+        std::string path;
+        std::shared_ptr<CompactionResult> result;
+        std::future<void> done;
+        // Appended to the old file while compacting, they go after the
+        // compacted records too
+        std::vector<std::byte> records;
+    };
+
+    auto StartFromProjectFile(const std::string& path,
+                              const std::string& project_path,
+                              Vec2Int canvas_dims,
+                              std::vector<LayerState> states) -> bool;
+    // Replaces the file at 'path' with one holding just the given record
+    auto StartWith(const std::string& path, Vec2Int canvas_dims,
+                   std::vector<LayerState> states, RecordType type,
+                   std::span<const std::byte> payload) -> bool;
+
+    // Snapshots the tiles on this thread and compacts on the thread pool.
+    // Only the tiles changed since the project file are snapshotted if the
+    // journal started from one, so tiles not loaded from it stay that way.
+    void BeginCompaction(const std::list<Layer>& layers);
+    // Swaps in the compacted file, if it's written by now
+    void FinishCompaction();
+    // Waits for the compaction and deletes what it wrote
+    void CancelCompaction();
+
+    static auto GetLayerStates(const std::list<Layer>& layers)
+        -> std::vector<LayerState>;
+    static void AppendLayerStates(const std::vector<LayerState>& states,
+                                  std::vector<std::byte>& dst);
+    // Appends a record to 'dst', with its header
+    static void AppendRecord(RecordType type,
+                             std::span<const std::byte> payload,
+                             std::vector<std::byte>& dst);
+
+    // Compacting isn't worth it for less
+    static constexpr std::size_t kMinCompactionSize = 1024UZ * 1024;
+
+    std::string mPath;
+    std::ofstream mFile;
+    Vec2Int mCanvasDims{0, 0};
+    std::vector<LayerState> mLastLayerStates;
+    // Of the layers being saved, set from BeginSave until EndSave
+    std::optional<std::vector<LayerState>> mSavedLayerStates;
+    std::vector<Layers::ChangedTile> mTilesChangedWhileSaving;
+    // Of the project file record the journal started with, if it did
+    std::optional<std::vector<std::byte>> mProjectFilePayload;
+    // Since the project file record, sorted and each one once
+    std::vector<Layers::ChangedTile> mTilesChangedSinceProjectFile;
+    std::optional<Compaction> mCompaction;
+    std::size_t mSnapshotSize = 0;
+    std::size_t mDeltaSize = 0;
+    bool mHasEdits = false;
+};
+} // namespace Pikzel
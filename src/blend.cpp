@@ -0,0 +1,230 @@
+#include "blend.hpp"
+
+#include <algorithm>
+#include <array>
+
+#if defined(__AVX2__)
+#define PIKZEL_BLEND_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define PIKZEL_BLEND_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Pikzel
+{
+namespace
+{
+static_assert(sizeof(Color) == 4, "Color has to be tightly packed RGBA8");
+
+constexpr uint32_t kMaxChannel = 0xff;
+
+// ceil(2^16 / alpha), clamped to 16 bits, in both halves so a 32 bit lane
+// has it for two 16 bit channels. 0 for alpha 0, which makes the pixel 0.
+constexpr auto kReciprocals = []
+{
+    std::array<uint32_t, kMaxChannel + 1> reciprocals{};
+
+    for (uint32_t alpha = 1; alpha < reciprocals.size(); alpha++)
+    {
+        const uint32_t reciprocal =
+            std::min(((1U << 16) + alpha - 1) / alpha, 0xffffU);
+        reciprocals[alpha] = reciprocal | (reciprocal << 16);
+    }
+
+    return reciprocals;
+}();
+
+// x / 255, rounded, for x up to 2^16 - 129
+auto Div255(uint32_t x) -> uint32_t
+{
+    return (x + 128 + ((x + 128) >> 8)) >> 8;
+}
+
+#if defined(PIKZEL_BLEND_AVX2)
+// The steps of BlendPixelOver on 16 bit channels, 2 pixels a 128 bit lane
+auto Div255(__m256i x) -> __m256i
+{
+    const __m256i rounded = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(
+        _mm256_add_epi16(rounded, _mm256_srli_epi16(rounded, 8)), 8);
+}
+
+// 'per_pixel' has a value below 2^16 in every 32 bit lane. Spreads those of
+// the low or the high 2 pixels of each 128 bit lane to all 4 channels.
+auto Spread(__m256i per_pixel, bool is_high) -> __m256i
+{
+    const __m256i doubled =
+        _mm256_or_si256(per_pixel, _mm256_slli_epi32(per_pixel, 16));
+    return is_high ? _mm256_unpackhi_epi32(doubled, doubled)
+                   : _mm256_unpacklo_epi32(doubled, doubled);
+}
+
+auto BlendUnpacked(__m256i dst, __m256i src, __m256i dst_alpha,
+                   __m256i src_alpha) -> __m256i
+{
+    const __m256i alpha_mask = _mm256_set1_epi64x(0xffffLL << 48);
+
+    const __m256i dst_weight = Div255(_mm256_mullo_epi16(
+        dst_alpha,
+        _mm256_sub_epi16(_mm256_set1_epi16(kMaxChannel), src_alpha)));
+    const __m256i out_alpha = _mm256_add_epi16(src_alpha, dst_weight);
+    const __m256i numerator =
+        _mm256_add_epi16(_mm256_mullo_epi16(src, src_alpha),
+                         _mm256_mullo_epi16(dst, dst_weight));
+    // Every 32 bit lane holds two channels of a single pixel
+    const __m256i reciprocals = _mm256_i32gather_epi32(
+        reinterpret_cast<const int*>(kReciprocals.data()),
+        _mm256_and_si256(out_alpha, _mm256_set1_epi32(0xffff)), 4);
+    const __m256i channels = _mm256_mulhi_epu16(
+        _mm256_add_epi16(numerator, _mm256_set1_epi16(1)), reciprocals);
+
+    return _mm256_or_si256(_mm256_andnot_si256(alpha_mask, channels),
+                           _mm256_and_si256(alpha_mask, out_alpha));
+}
+
+// Blends 8 pixels, bit-exact with BlendPixelOver
+auto BlendEightOver(__m256i dst, __m256i src, __m256i opacity) -> __m256i
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i transparent =
+        _mm256_cmpeq_epi32(_mm256_srli_epi32(src, 24), zero);
+    const __m256i src_alpha = _mm256_andnot_si256(transparent, opacity);
+    const __m256i dst_alpha = _mm256_srli_epi32(dst, 24);
+
+    const __m256i low = BlendUnpacked(
+        _mm256_unpacklo_epi8(dst, zero), _mm256_unpacklo_epi8(src, zero),
+        Spread(dst_alpha, false), Spread(src_alpha, false));
+    const __m256i high = BlendUnpacked(
+        _mm256_unpackhi_epi8(dst, zero), _mm256_unpackhi_epi8(src, zero),
+        Spread(dst_alpha, true), Spread(src_alpha, true));
+
+    // Saturates, like the min of BlendPixelOver
+    return _mm256_packus_epi16(low, high);
+}
+#elif defined(PIKZEL_BLEND_SSE2)
+// The steps of BlendPixelOver on 16 bit channels, 2 pixels a register
+auto Div255(__m128i x) -> __m128i
+{
+    const __m128i rounded = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(rounded, _mm_srli_epi16(rounded, 8)),
+                          8);
+}
+
+// 'per_pixel' has a value below 2^16 in every 32 bit lane. Spreads those of
+// the low or the high 2 pixels to all 4 channels.
+auto Spread(__m128i per_pixel, bool is_high) -> __m128i
+{
+    const __m128i doubled =
+        _mm_or_si128(per_pixel, _mm_slli_epi32(per_pixel, 16));
+    return is_high ? _mm_unpackhi_epi32(doubled, doubled)
+                   : _mm_unpacklo_epi32(doubled, doubled);
+}
+
+auto BlendUnpacked(__m128i dst, __m128i src, __m128i dst_alpha,
+                   __m128i src_alpha) -> __m128i
+{
+    const __m128i alpha_mask = _mm_set1_epi64x(0xffffLL << 48);
+
+    const __m128i dst_weight = Div255(_mm_mullo_epi16(
+        dst_alpha, _mm_sub_epi16(_mm_set1_epi16(kMaxChannel), src_alpha)));
+    const __m128i out_alpha = _mm_add_epi16(src_alpha, dst_weight);
+    const __m128i numerator = _mm_add_epi16(_mm_mullo_epi16(src, src_alpha),
+                                            _mm_mullo_epi16(dst, dst_weight));
+    // No gather in SSE2, it's two loads
+    const auto first_alpha =
+        static_cast<std::size_t>(_mm_extract_epi16(out_alpha, 0));
+    const auto second_alpha =
+        static_cast<std::size_t>(_mm_extract_epi16(out_alpha, 4));
+    const auto first = static_cast<int>(kReciprocals[first_alpha]);
+    const auto second = static_cast<int>(kReciprocals[second_alpha]);
+    const __m128i reciprocals = _mm_set_epi32(second, second, first, first);
+    const __m128i channels = _mm_mulhi_epu16(
+        _mm_add_epi16(numerator, _mm_set1_epi16(1)), reciprocals);
+
+    return _mm_or_si128(_mm_andnot_si128(alpha_mask, channels),
+                        _mm_and_si128(alpha_mask, out_alpha));
+}
+
+// Blends 4 pixels, bit-exact with BlendPixelOver
+auto BlendFourOver(__m128i dst, __m128i src, __m128i opacity) -> __m128i
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i transparent =
+        _mm_cmpeq_epi32(_mm_srli_epi32(src, 24), zero);
+    const __m128i src_alpha = _mm_andnot_si128(transparent, opacity);
+    const __m128i dst_alpha = _mm_srli_epi32(dst, 24);
+
+    const __m128i low = BlendUnpacked(
+        _mm_unpacklo_epi8(dst, zero), _mm_unpacklo_epi8(src, zero),
+        Spread(dst_alpha, false), Spread(src_alpha, false));
+    const __m128i high = BlendUnpacked(
+        _mm_unpackhi_epi8(dst, zero), _mm_unpackhi_epi8(src, zero),
+        Spread(dst_alpha, true), Spread(src_alpha, true));
+
+    // Saturates, like the min of BlendPixelOver
+    return _mm_packus_epi16(low, high);
+}
+#endif
+} // namespace
+
+auto BlendPixelOver(Color src, Color dst) -> Color
+{
+    const uint32_t dst_weight = Div255(dst.a * (kMaxChannel - src.a));
+    const uint32_t out_alpha = src.a + dst_weight;
+    const uint32_t reciprocal = kReciprocals[out_alpha] & 0xffffU;
+
+    auto blend_channel = [&](uint32_t src_channel, uint32_t dst_channel)
+    {
+        const uint32_t numerator =
+            (src_channel * src.a) + (dst_channel * dst_weight);
+        return static_cast<uint8_t>(
+            std::min(((numerator + 1) * reciprocal) >> 16, kMaxChannel));
+    };
+
+    return {.r = blend_channel(src.r, dst.r),
+            .g = blend_channel(src.g, dst.g),
+            .b = blend_channel(src.b, dst.b),
+            .a = static_cast<uint8_t>(out_alpha)};
+}
+
+void BlendRowOver(Color* dst, const Color* src, std::size_t count,
+                  uint8_t opacity)
+{
+    std::size_t i = 0;
+
+#if defined(PIKZEL_BLEND_AVX2)
+    constexpr std::size_t kPixelsPerStep = 8;
+    const __m256i opacity_vec = _mm256_set1_epi32(opacity);
+
+    for (; i + kPixelsPerStep <= count; i += kPixelsPerStep)
+    {
+        auto* dst_ptr = reinterpret_cast<__m256i*>(dst + i);
+        const auto* src_ptr = reinterpret_cast<const __m256i*>(src + i);
+        _mm256_storeu_si256(dst_ptr,
+                            BlendEightOver(_mm256_loadu_si256(dst_ptr),
+                                           _mm256_loadu_si256(src_ptr),
+                                           opacity_vec));
+    }
+#elif defined(PIKZEL_BLEND_SSE2)
+    constexpr std::size_t kPixelsPerStep = 4;
+    const __m128i opacity_vec = _mm_set1_epi32(opacity);
+
+    for (; i + kPixelsPerStep <= count; i += kPixelsPerStep)
+    {
+        auto* dst_ptr = reinterpret_cast<__m128i*>(dst + i);
+        const auto* src_ptr = reinterpret_cast<const __m128i*>(src + i);
+        _mm_storeu_si128(dst_ptr, BlendFourOver(_mm_loadu_si128(dst_ptr),
+                                                _mm_loadu_si128(src_ptr),
+                                                opacity_vec));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        Color pixel = src[i];
+        pixel.a = pixel.a == 0 ? pixel.a : opacity;
+        dst[i] = BlendPixelOver(pixel, dst[i]);
+    }
+}
+} // namespace Pikzel
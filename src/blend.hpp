@@ -0,0 +1,25 @@
+#pragma once
+
+#include "color.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Pikzel
+{
+// Source-over blending in 8-bit integers. With w2 = a2 * (255 - a1) / 255,
+// rounded:
+//   out_a = a1 + w2
+//   out_c = (c1 * a1 + c2 * w2) / out_a
+// where the last division is a multiply by a reciprocal from a table. The
+// SIMD kernels do the same steps on 16 bit channels, so they're bit-exact
+// with BlendPixelOver. Compared to exact math a channel can differ by 1, by
+// a few more where out_a is low and the pixel is mostly transparent.
+auto BlendPixelOver(Color src, Color dst) -> Color;
+
+// Blends 'count' pixels of 'src' over 'dst', in place. Like a layer is
+// composited, 'opacity' replaces the alpha of every src pixel which isn't
+// fully transparent. Uses AVX2 or SSE2 if the build targets them.
+void BlendRowOver(Color* dst, const Color* src, std::size_t count,
+                  uint8_t opacity);
+} // namespace Pikzel
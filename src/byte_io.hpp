@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Little endian numbers in byte buffers, for the file formats
+namespace Pikzel::ByteIo
+{
+template <typename T> void Append(T value, std::vector<std::byte>& dst)
+{
+    for (std::size_t i = 0; i < sizeof(T); i++)
+    {
+        dst.push_back(static_cast<std::byte>(value >> (i * 8)));
+    }
+}
+
+// Every read fails once one went past the end
+class Reader
+{
+  public:
+    explicit Reader(std::span<const std::byte> data) : mData{data} {}
+
+    template <typename T> auto Read() -> T
+    {
+        if (mPos + sizeof(T) > mData.size())
+        {
+            mFailed = true;
+            return 0;
+        }
+
+        T value = 0;
+        for (std::size_t i = 0; i < sizeof(T); i++)
+        {
+            value |= static_cast<T>(static_cast<T>(mData[mPos + i]) << (i * 8));
+        }
+
+        mPos += sizeof(T);
+        return value;
+    }
+
+    auto ReadBytes(std::size_t count) -> std::span<const std::byte>
+    {
+        if (count > mData.size() - mPos)
+        {
+            mFailed = true;
+            return {};
+        }
+
+        auto bytes = mData.subspan(mPos, count);
+        mPos += count;
+        return bytes;
+    }
+
+    [[nodiscard]] auto HasFailed() const -> bool { return mFailed; }
+    [[nodiscard]] auto IsAtEnd() const -> bool { return mPos == mData.size(); }
+
+  private:
+    std::span<const std::byte> mData;
+    std::size_t mPos = 0;
+    bool mFailed = false;
+};
+} // namespace Pikzel::ByteIo
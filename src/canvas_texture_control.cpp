@@ -0,0 +1,232 @@
+#include "canvas_texture_control.hpp"
+
+#include "gla/renderer.hpp"
+#include "gla/vertex_buffer_layout.hpp"
+#include "thread_pool.hpp"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <ranges>
+
+namespace Pikzel
+{
+CanvasTextureControl::CanvasTextureControl(Layers& layers)
+    : mLayers{layers}, mPixelBuffer{kPixelBufferRegionSize},
+      mQuadVbo{nullptr, 0, Gla::kStaticDraw}
+{
+    const auto width = static_cast<float>(layers.GetCanvasDims().x);
+    const auto height = static_cast<float>(layers.GetCanvasDims().y);
+
+    // Texture row 0 holds canvas row 0, so the texture coordinates follow the
+    // canvas coordinates
+    const std::array<TexturedVertex, kVerticesPerQuad> quad = {
+        // first triangle
+        TexturedVertex{.pos_x = 0, .pos_y = 0, .tex_u = 0, .tex_v = 0},
+        TexturedVertex{.pos_x = width, .pos_y = 0, .tex_u = 1, .tex_v = 0},
+        TexturedVertex{.pos_x = 0, .pos_y = height, .tex_u = 0, .tex_v = 1},
+        // second triangle
+        TexturedVertex{.pos_x = width, .pos_y = 0, .tex_u = 1, .tex_v = 0},
+        TexturedVertex{.pos_x = width, .pos_y = height, .tex_u = 1, .tex_v = 1},
+        TexturedVertex{.pos_x = 0, .pos_y = height, .tex_u = 0, .tex_v = 1},
+    };
+
+    mQuadVbo.UpdateSize(sizeof(quad));
+    mQuadVbo.UpdateData(quad.data(), sizeof(quad));
+
+    Gla::VertexBufferLayout layout;
+    layout.Push<float>(2);
+    layout.Push<float>(2);
+    mQuadVao.AddBuffer(mQuadVbo, layout);
+}
+
+void CanvasTextureControl::Update(bool should_update_all)
+{
+    static_assert(sizeof(Color) == 4, "Color has to be tightly packed RGBA8");
+
+    // Layers could have been added or removed anywhere in the list
+    if (UpdateTextureCountIfNeeded()) { should_update_all = true; }
+
+    if (should_update_all)
+    {
+        mIsTextureStale.assign(mLayerTextures.size(), true);
+    }
+
+    const Rect whole_canvas{.upper_left = {0, 0},
+                            .bottom_right = mLayers.get().GetCanvasDims()};
+    std::size_t upload_size = 0;
+    std::size_t layer_index = 0;
+    mUploads.clear();
+
+    for (auto& layer : mLayers.get().GetLayers())
+    {
+        Rect rect = layer.TakeDirtyRect();
+
+        if (!layer.IsVisible() || layer.GetOpacity() == 0)
+        {
+            if (!rect.IsEmpty()) { mIsTextureStale[layer_index] = true; }
+
+            layer_index++;
+            continue;
+        }
+
+        if (mIsTextureStale[layer_index])
+        {
+            rect = whole_canvas;
+            mIsTextureStale[layer_index] = false;
+        }
+
+        if (!rect.IsEmpty())
+        {
+            const auto rect_size = rect.Area() * sizeof(Color);
+            std::optional<std::size_t> offset;
+
+            if (upload_size + rect_size <= mPixelBuffer.GetSize())
+            {
+                offset = upload_size;
+                upload_size += rect_size;
+            }
+
+            mUploads.push_back({.layer = &layer,
+                                .layer_index = layer_index,
+                                .rect = rect,
+                                .offset = offset});
+        }
+
+        layer_index++;
+    }
+
+    if (mUploads.empty()) { return; }
+
+    std::byte* region_data =
+        upload_size != 0
+            ? static_cast<std::byte*>(mPixelBuffer.BeginStreamWrite())
+            : nullptr;
+
+    // Each upload has its own part of the region. Tiles of a freshly opened
+    // project get decoded here, so this spreads that across the layers too.
+    ThreadPool::Get().ParallelFor(
+        mUploads.size(),
+        [this, region_data](std::size_t i)
+        {
+            const auto& upload = mUploads[i];
+
+            if (!upload.offset.has_value())
+            {
+                // Uploaded straight from the tiles below, only loaded here
+                const auto& canvas = upload.layer->GetCanvas();
+
+                for (std::size_t tile = 0; tile < canvas.GetTileCount();
+                     tile++)
+                {
+                    if (!Intersect(canvas.GetTileRect(tile), upload.rect)
+                             .IsEmpty())
+                    {
+                        (void)canvas.GetTileHandle(tile);
+                    }
+                }
+
+                return;
+            }
+
+            upload.layer->CopyRectTo(
+                upload.rect,
+                std::bit_cast<Color*>(region_data + upload.offset.value()));
+        });
+
+    if (upload_size != 0) { mPixelBuffer.EndStreamWrite(); }
+
+    const auto region_offset = mPixelBuffer.GetStreamRegionOffset();
+
+    for (const auto& upload : mUploads)
+    {
+        const auto& texture = mLayerTextures.at(upload.layer_index);
+        const auto& rect = upload.rect;
+
+        if (upload.offset.has_value())
+        {
+            mPixelBuffer.Bind();
+            texture->UpdateData(
+                rect.upper_left.x, rect.upper_left.y, rect.Width(),
+                rect.Height(),
+                std::bit_cast<const void*>(
+                    static_cast<uintptr_t>(region_offset + *upload.offset)));
+            continue;
+        }
+
+        // Doesn't fit the pixel buffer, so every tile overlapping the rect is
+        // uploaded straight from its memory
+        const auto& canvas = upload.layer->GetCanvas();
+        Gla::PixelUnpackBuffer::Unbind();
+
+        for (std::size_t tile = 0; tile < canvas.GetTileCount(); tile++)
+        {
+            const Rect tile_rect = canvas.GetTileRect(tile);
+            const Rect part = Intersect(tile_rect, rect);
+
+            if (part.IsEmpty()) { continue; }
+
+            const auto first_pixel =
+                TiledCanvas::PixelIndexInTile(part.upper_left);
+            texture->UpdateData(part.upper_left.x, part.upper_left.y,
+                                part.Width(), part.Height(),
+                                canvas.GetTile(tile).data() + first_pixel,
+                                TiledCanvas::kTileSize);
+        }
+    }
+
+    if (upload_size != 0) { mPixelBuffer.FenceStreamRegion(); }
+
+    Gla::PixelUnpackBuffer::Unbind();
+}
+
+void CanvasTextureControl::Draw(Gla::Shader& shader) const
+{
+    mQuadVao.Bind();
+    shader.Bind();
+    shader.SetUniform1i("u_Texture", 0);
+
+    const auto& layers = mLayers.get().GetLayers();
+    auto texture_it = mLayerTextures.begin();
+    std::advance(texture_it, layers.size());
+
+    // The first layer in the list is the top one
+    for (const auto& layer : std::ranges::reverse_view(layers))
+    {
+        texture_it--;
+
+        if (!layer.IsVisible() || layer.GetOpacity() == 0) { continue; }
+
+        (*texture_it)->Bind(0);
+        shader.SetUniform1f("u_Opacity",
+                            static_cast<float>(layer.GetOpacity()) / 0xff);
+        Gla::Renderer::DrawArrays(Gla::kTriangles, kVerticesPerQuad);
+    }
+}
+
+void CanvasTextureControl::DrawBackground(Gla::Shader& shader) const
+{
+    mQuadVao.Bind();
+    shader.Bind();
+    Gla::Renderer::DrawArrays(Gla::kTriangles, kVerticesPerQuad);
+}
+
+auto CanvasTextureControl::UpdateTextureCountIfNeeded() -> bool
+{
+    const auto layer_count = mLayers.get().GetLayerCount();
+
+    if (mLayerTextures.size() == layer_count) { return false; }
+
+    const auto canvas_dims = mLayers.get().GetCanvasDims();
+
+    while (mLayerTextures.size() < layer_count)
+    {
+        mLayerTextures.push_back(
+            std::make_unique<Gla::Texture2D>(canvas_dims.x, canvas_dims.y));
+    }
+
+    mLayerTextures.resize(layer_count);
+    return true;
+}
+} // namespace Pikzel
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "gla/pixel_buffer.hpp"
+#include "gla/shader.hpp"
+#include "gla/texture.hpp"
+#include "gla/vertex_array.hpp"
+#include "gla/vertex_buffer.hpp"
+#include "layer.hpp"
+#include "layer_control.hpp"
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace Pikzel
+{
+struct TexturedVertex
+{
+    float pos_x{}, pos_y{};
+    float tex_u{}, tex_v{};
+};
+
+// Every layer lives on the GPU as one RGBA8 texture which is drawn as a single
+// canvas sized quad, so the GPU memory needed is 4 bytes per pixel per layer.
+// Only the bounding rects of the pixels drawn since the last frame are
+// uploaded, streamed through a persistently mapped pixel unpack buffer.
+class CanvasTextureControl
+{
+  public:
+    // Should run this after creating/opening a project
+    explicit CanvasTextureControl(Layers& layers);
+    CanvasTextureControl(const CanvasTextureControl&) = delete;
+    CanvasTextureControl(CanvasTextureControl&&) = delete;
+    auto operator=(const CanvasTextureControl&)
+        -> CanvasTextureControl& = delete;
+    auto operator=(CanvasTextureControl&&) -> CanvasTextureControl& = delete;
+    ~CanvasTextureControl() = default;
+
+    void Update(bool should_update_all);
+    // Draws the layers from the bottom one to the top one. Binds the shader,
+    // the shader should have u_ViewProjection already set.
+    void Draw(Gla::Shader& shader) const;
+    // Draws the canvas quad once, for shaders which only need the canvas
+    // coordinates, like the checkerboard background. Binds the shader.
+    void DrawBackground(Gla::Shader& shader) const;
+
+  private:
+    static constexpr int kVerticesPerQuad = 6;
+    // Size of one region of the pixel buffer. Rects which don't fit anymore
+    // are uploaded straight from the layer.
+    static constexpr std::size_t kPixelBufferRegionSize = 4UZ * 1024 * 1024;
+
+    struct Upload
+    {
+        const Layer* layer;
+        std::size_t layer_index;
+        Rect rect;
+        // In bytes, from the start of the region, if the rect is staged
+        std::optional<std::size_t> offset;
+    };
+
+    // Returns true if the texture count changed
+    auto UpdateTextureCountIfNeeded() -> bool;
+
+    std::reference_wrapper<Layers> mLayers;
+    std::vector<std::unique_ptr<Gla::Texture2D>> mLayerTextures;
+    // Textures of hidden layers which missed updates. They're uploaded whole
+    // once the layer is shown, until then its tiles don't even get loaded.
+    std::vector<bool> mIsTextureStale;
+    Gla::PixelUnpackBuffer mPixelBuffer;
+    std::vector<Upload> mUploads;
+    Gla::VertexArray mQuadVao;
+    Gla::VertexBuffer mQuadVbo;
+};
+} // namespace Pikzel
@@ -0,0 +1,45 @@
+#include "color.hpp"
+
+#include "blend.hpp"
+
+#include <cmath>
+
+namespace Pikzel
+{
+auto Color::operator=(const ImVec4& color) -> Color&
+{
+    r = static_cast<uint8_t>(color.x * 255);
+    g = static_cast<uint8_t>(color.y * 255);
+    b = static_cast<uint8_t>(color.z * 255);
+    a = static_cast<uint8_t>(color.w * 255);
+    return *this;
+}
+
+auto Color::operator==(const Color& other) const -> bool
+{
+    return other.r == r && other.g == g && other.b == b && other.a == a;
+}
+
+auto Color::operator==(const ImVec4& other) const -> bool
+{
+    constexpr float kTolerance = 0.0025F;
+
+    return std::abs((static_cast<float>(r) / 0xff) - other.x) <= kTolerance &&
+           std::abs((static_cast<float>(g) / 0xff) - other.y) <= kTolerance &&
+           std::abs((static_cast<float>(b) / 0xff) - other.z) <= kTolerance &&
+           std::abs((static_cast<float>(a) / 0xff) - other.w) <= kTolerance;
+}
+
+auto Color::BlendColor(Color color1, Color color2) -> Color
+{
+    return BlendPixelOver(color1, color2);
+}
+
+auto Color::FromImVec4(const ImVec4 color) -> Color
+{
+    return {.r = static_cast<uint8_t>(color.x * 0xff),
+            .g = static_cast<uint8_t>(color.y * 0xff),
+            .b = static_cast<uint8_t>(color.z * 0xff),
+            .a = static_cast<uint8_t>(color.w * 0xff)};
+}
+} // namespace Pikzel
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <imgui.h>
+
+#include <cstdint>
+
+namespace Pikzel
+{
+struct Color
+{
+    auto operator=(const ImVec4& color) -> Color&;
+    auto operator==(const Color& other) const -> bool;
+    auto operator==(const ImVec4& other) const -> bool;
+
+    // Blends color1 over color2, see BlendPixelOver
+    static auto BlendColor(Color color1, Color color2) -> Color;
+    static auto FromImVec4(ImVec4 color) -> Color;
+
+    uint8_t r = 0, g = 0, b = 0, a = 0;
+};
+} // namespace Pikzel
@@ -0,0 +1,203 @@
+#include "compression.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+namespace Pikzel::Compression
+{
+namespace
+{
+constexpr std::size_t kMinMatch = 4;
+constexpr std::size_t kMaxOffset = 0xffff;
+constexpr std::size_t kHashBits = 14;
+constexpr uint8_t kNibbleMax = 15;
+constexpr uint8_t kLengthByteMax = 255;
+
+auto Read32(const std::byte* src) -> uint32_t
+{
+    uint32_t value = 0;
+    std::memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+auto Hash(uint32_t sequence) -> std::size_t
+{
+    // Knuth's multiplicative hash
+    constexpr uint32_t kPrime = 2654435761U;
+    return (sequence * kPrime) >> (32 - kHashBits);
+}
+
+void WriteLength(std::size_t length, std::vector<std::byte>& dst)
+{
+    while (length >= kLengthByteMax)
+    {
+        dst.push_back(std::byte{kLengthByteMax});
+        length -= kLengthByteMax;
+    }
+
+    dst.push_back(static_cast<std::byte>(length));
+}
+
+auto ReadLength(std::span<const std::byte> src, std::size_t& pos,
+                std::size_t& length) -> bool
+{
+    uint8_t byte = kLengthByteMax;
+
+    while (byte == kLengthByteMax)
+    {
+        if (pos >= src.size()) { return false; }
+
+        byte = static_cast<uint8_t>(src[pos++]);
+        length += byte;
+    }
+
+    return true;
+}
+
+void WriteSequence(std::span<const std::byte> literals, std::size_t offset,
+                   std::size_t match_length, std::vector<std::byte>& dst)
+{
+    const auto literal_nibble =
+        static_cast<uint8_t>(std::min<std::size_t>(literals.size(),
+                                                   kNibbleMax));
+    const std::size_t match_rest = match_length == 0
+                                       ? 0
+                                       : match_length - kMinMatch;
+    const auto match_nibble =
+        static_cast<uint8_t>(std::min<std::size_t>(match_rest, kNibbleMax));
+
+    dst.push_back(static_cast<std::byte>((literal_nibble << 4) | match_nibble));
+
+    if (literal_nibble == kNibbleMax)
+    {
+        WriteLength(literals.size() - kNibbleMax, dst);
+    }
+
+    dst.insert(dst.end(), literals.begin(), literals.end());
+
+    if (match_length == 0) { return; }
+
+    dst.push_back(static_cast<std::byte>(offset & 0xff));
+    dst.push_back(static_cast<std::byte>(offset >> 8));
+
+    if (match_nibble == kNibbleMax)
+    {
+        WriteLength(match_rest - kNibbleMax, dst);
+    }
+}
+} // namespace
+
+void Compress(std::span<const std::byte> src, std::vector<std::byte>& dst)
+{
+    // Positions + 1 of the last occurrences of hashed 4 byte sequences,
+    // 0 means none
+    std::array<uint32_t, 1UZ << kHashBits> last_positions{};
+    std::size_t literal_begin = 0;
+    std::size_t pos = 0;
+
+    while (pos + kMinMatch <= src.size())
+    {
+        const auto sequence = Read32(&src[pos]);
+        auto& last_position = last_positions[Hash(sequence)];
+        const std::size_t candidate = last_position;
+        last_position = static_cast<uint32_t>(pos + 1);
+
+        if (candidate == 0 || pos + 1 - candidate > kMaxOffset ||
+            Read32(&src[candidate - 1]) != sequence)
+        {
+            pos++;
+            continue;
+        }
+
+        const std::size_t match_begin = candidate - 1;
+        std::size_t match_length = kMinMatch;
+
+        while (pos + match_length < src.size() &&
+               src[match_begin + match_length] == src[pos + match_length])
+        {
+            match_length++;
+        }
+
+        WriteSequence(src.subspan(literal_begin, pos - literal_begin),
+                      pos - match_begin, match_length, dst);
+        pos += match_length;
+        literal_begin = pos;
+    }
+
+    WriteSequence(src.subspan(literal_begin), 0, 0, dst);
+}
+
+auto Compress(std::span<const std::byte> src) -> std::vector<std::byte>
+{
+    std::vector<std::byte> dst;
+    Compress(src, dst);
+    return dst;
+}
+
+auto Decompress(std::span<const std::byte> src,
+                std::span<std::byte> dst) -> bool
+{
+    std::size_t src_pos = 0;
+    std::size_t dst_pos = 0;
+
+    while (src_pos < src.size())
+    {
+        const auto token = static_cast<uint8_t>(src[src_pos++]);
+        std::size_t literal_length = token >> 4;
+
+        if (literal_length == kNibbleMax &&
+            !ReadLength(src, src_pos, literal_length))
+        {
+            return false;
+        }
+
+        if (literal_length > src.size() - src_pos ||
+            literal_length > dst.size() - dst_pos)
+        {
+            return false;
+        }
+
+        if (literal_length != 0)
+        {
+            std::memcpy(dst.data() + dst_pos, src.data() + src_pos,
+                        literal_length);
+        }
+        src_pos += literal_length;
+        dst_pos += literal_length;
+
+        // The last sequence has no match
+        if (src_pos == src.size()) { break; }
+
+        if (src.size() - src_pos < 2) { return false; }
+
+        const std::size_t offset = static_cast<uint8_t>(src[src_pos]) |
+                                   (static_cast<uint8_t>(src[src_pos + 1])
+                                    << 8);
+        src_pos += 2;
+
+        std::size_t match_length = token & kNibbleMax;
+        if (match_length == kNibbleMax &&
+            !ReadLength(src, src_pos, match_length))
+        {
+            return false;
+        }
+        match_length += kMinMatch;
+
+        if (offset == 0 || offset > dst_pos ||
+            match_length > dst.size() - dst_pos)
+        {
+            return false;
+        }
+
+        // Byte by byte, the source can overlap what's being written
+        for (std::size_t i = 0; i < match_length; i++, dst_pos++)
+        {
+            dst[dst_pos] = dst[dst_pos - offset];
+        }
+    }
+
+    return dst_pos == dst.size();
+}
+} // namespace Pikzel::Compression
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace Pikzel::Compression
+{
+// Byte oriented LZ codec in the spirit of LZ4. A block is a sequence of
+// tokens, each a run of literals followed by a copy of earlier output. Copies
+// may overlap what they produce, so runs of one repeated pixel (the common
+// case in pixel art) become a single 4 byte back reference, like RLE.
+//
+// Token layout: one byte with the literal count in the high nibble and the
+// match length minus kMinMatch in the low one (15 means more length bytes
+// follow, each adding up to 255), the literals, then a 2 byte little endian
+// offset and the remaining match length bytes. The last token has literals
+// only.
+
+// Appends the compressed 'src' to 'dst'
+void Compress(std::span<const std::byte> src, std::vector<std::byte>& dst);
+[[nodiscard]] auto Compress(std::span<const std::byte> src)
+    -> std::vector<std::byte>;
+
+// Decompresses into 'dst', which has to be exactly the uncompressed size.
+// Returns false if 'src' is corrupted.
+[[nodiscard]] auto Decompress(std::span<const std::byte> src,
+                              std::span<std::byte> dst) -> bool;
+} // namespace Pikzel::Compression
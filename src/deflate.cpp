@@ -0,0 +1,810 @@
+#include "deflate.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <functional>
+#include <numeric>
+
+namespace Pikzel
+{
+namespace
+{
+struct HuffmanCode
+{
+    uint16_t bits;
+    uint8_t length;
+};
+
+// A literal if 'distance' is 0, then 'length' is the byte
+struct Token
+{
+    uint16_t length;
+    uint16_t distance;
+};
+
+constexpr std::array<uint16_t, 29> kLengthBase = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr std::array<uint8_t, 29> kLengthExtraBits = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+    2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr std::array<uint16_t, 30> kDistanceBase = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr std::array<uint8_t, 30> kDistanceExtraBits = {
+    0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// The code length codes are sent in this order, the ones least likely to
+// be used last
+constexpr std::array<uint8_t, 19> kCodeLengthOrder = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+constexpr std::size_t kWindowSize = 32768;
+constexpr std::size_t kMinMatch = 3;
+constexpr std::size_t kMaxMatch = 258;
+constexpr uint32_t kHashBits = 15;
+// Candidates looked at for each position, more is slower but finds longer
+// matches
+constexpr std::size_t kMaxChainLength = 8;
+// Positions inside of longer matches aren't hashed, runs are found without
+// the hash chains anyway
+constexpr std::size_t kMaxInsertLength = 16;
+// Distances tried before the hash chains, the byte and the pixel before
+constexpr std::array<std::size_t, 2> kRunDistances = {1, 4};
+// A block per this many tokens, each with codes built for it
+constexpr std::size_t kMaxBlockTokens = 64UZ * 1024;
+constexpr std::size_t kMaxStoredBlockSize = 65535;
+constexpr int32_t kNoPos = -1;
+
+constexpr uint32_t kLiteralCount = 286;
+constexpr uint32_t kDistanceCount = 30;
+constexpr uint32_t kCodeLengthCount = 19;
+constexpr uint32_t kMaxCodeLength = 15;
+constexpr uint32_t kMaxCodeLengthCodeLength = 7;
+constexpr uint32_t kEndOfBlock = 256;
+constexpr uint32_t kFirstLengthSymbol = 257;
+constexpr uint32_t kAdlerModulo = 65521;
+// The most bytes summed before the Adler sums could overflow
+constexpr std::size_t kAdlerBlockSize = 5552;
+
+// Deflate writes the Huffman codes starting from their top bit
+constexpr auto ReverseBits(uint32_t bits, uint32_t count) -> uint16_t
+{
+    uint32_t reversed = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        reversed = (reversed << 1U) | ((bits >> i) & 1U);
+    }
+
+    return static_cast<uint16_t>(reversed);
+}
+
+constexpr auto MakeLengthSymbols() -> std::array<uint8_t, 259>
+{
+    std::array<uint8_t, 259> symbols{};
+
+    for (uint8_t code = 0; code < kLengthBase.size(); code++)
+    {
+        const auto last = code + 1UZ < kLengthBase.size()
+                              ? kLengthBase[code + 1UZ]
+                              : kLengthBase[code] + 1U;
+
+        for (auto length = kLengthBase[code]; length < last; length++)
+        {
+            symbols[length] = code;
+        }
+    }
+
+    return symbols;
+}
+
+// From a match length to the index of its length code
+constexpr auto kLengthSymbols = MakeLengthSymbols();
+
+auto GetDistanceSymbol(std::size_t distance) -> std::size_t
+{
+    const auto* iter = std::upper_bound(kDistanceBase.begin(),
+                                        kDistanceBase.end(), distance);
+    return static_cast<std::size_t>(iter - kDistanceBase.begin()) - 1;
+}
+
+auto Hash(const std::byte* data) -> std::size_t
+{
+    constexpr uint32_t kMultiplier = 2654435761U;
+    const auto value = static_cast<uint32_t>(data[0]) |
+                       (static_cast<uint32_t>(data[1]) << 8U) |
+                       (static_cast<uint32_t>(data[2]) << 16U);
+    return (value * kMultiplier) >> (32U - kHashBits);
+}
+
+// How many bytes at 'pos' repeat the ones at 'candidate', up to 'max_length'
+auto GetMatchLength(const std::byte* data, std::size_t candidate,
+                    std::size_t pos, std::size_t max_length) -> std::size_t
+{
+    std::size_t length = 0;
+
+    if constexpr (std::endian::native == std::endian::little)
+    {
+        // 8 bytes at a time, the lowest differing bit is in the first
+        // differing byte
+        for (; length + sizeof(uint64_t) <= max_length;
+             length += sizeof(uint64_t))
+        {
+            uint64_t lhs = 0;
+            uint64_t rhs = 0;
+            std::memcpy(&lhs, data + candidate + length, sizeof(lhs));
+            std::memcpy(&rhs, data + pos + length, sizeof(rhs));
+
+            if (lhs != rhs)
+            {
+                return length + (std::countr_zero(lhs ^ rhs) / 8);
+            }
+        }
+    }
+
+    while (length < max_length &&
+           data[candidate + length] == data[pos + length])
+    {
+        length++;
+    }
+
+    return length;
+}
+
+// LZ77, greedy
+auto FindTokens(std::span<const std::byte> input) -> std::vector<Token>
+{
+    std::vector<Token> tokens;
+    std::vector<int32_t> head(1UZ << kHashBits, kNoPos);
+    std::vector<int32_t> prev(kWindowSize, kNoPos);
+    const auto* data = input.data();
+    const auto size = input.size();
+
+    const auto insert = [&](std::size_t pos)
+    {
+        if (pos + kMinMatch > size) { return; }
+
+        auto& first = head[Hash(data + pos)];
+        prev[pos % kWindowSize] = first;
+        first = static_cast<int32_t>(pos);
+    };
+
+    std::size_t pos = 0;
+
+    while (pos < size)
+    {
+        const auto max_length = std::min(kMaxMatch, size - pos);
+        std::size_t best_length = 0;
+        std::size_t best_distance = 0;
+
+        if (max_length >= kMinMatch)
+        {
+            for (const auto distance : kRunDistances)
+            {
+                if (distance > pos) { break; }
+
+                const auto length =
+                    GetMatchLength(data, pos - distance, pos, max_length);
+
+                if (length > best_length)
+                {
+                    best_length = length;
+                    best_distance = distance;
+                }
+            }
+
+            auto candidate = head[Hash(data + pos)];
+
+            for (std::size_t i = 0; i < kMaxChainLength &&
+                                    best_length < max_length &&
+                                    candidate != kNoPos;
+                 i++)
+            {
+                const auto candidate_pos = static_cast<std::size_t>(candidate);
+
+                // The slot was reused by a newer position, the chain ends
+                if (candidate_pos >= pos || pos - candidate_pos > kWindowSize)
+                {
+                    break;
+                }
+
+                // Can't be longer unless it matches at the end of the best
+                if (data[candidate_pos + best_length] ==
+                    data[pos + best_length])
+                {
+                    const auto length =
+                        GetMatchLength(data, candidate_pos, pos, max_length);
+
+                    if (length > best_length)
+                    {
+                        best_length = length;
+                        best_distance = pos - candidate_pos;
+                    }
+                }
+
+                const auto next = prev[candidate_pos % kWindowSize];
+
+                if (next >= candidate) { break; }
+
+                candidate = next;
+            }
+        }
+
+        if (best_length < kMinMatch)
+        {
+            insert(pos);
+            tokens.push_back({.length = static_cast<uint16_t>(data[pos]),
+                              .distance = 0});
+            pos++;
+            continue;
+        }
+
+        tokens.push_back({.length = static_cast<uint16_t>(best_length),
+                          .distance = static_cast<uint16_t>(best_distance)});
+
+        if (best_length <= kMaxInsertLength)
+        {
+            for (std::size_t i = 0; i < best_length; i++) { insert(pos + i); }
+        }
+        else { insert(pos + best_length - 1); }
+
+        pos += best_length;
+    }
+
+    return tokens;
+}
+
+// Huffman code lengths no longer than 'max_length', for the symbols used.
+// Like miniz, the tree is built as usual and then the too long codes are
+// moved up, which is close to optimal.
+void BuildCodeLengths(std::span<const uint32_t> frequencies,
+                      uint32_t max_length, std::span<uint8_t> lengths)
+{
+    std::ranges::fill(lengths, uint8_t{0});
+
+    std::vector<uint32_t> symbols;
+
+    for (uint32_t i = 0; i < frequencies.size(); i++)
+    {
+        if (frequencies[i] != 0) { symbols.push_back(i); }
+    }
+
+    if (symbols.empty()) { return; }
+
+    if (symbols.size() == 1)
+    {
+        lengths[symbols[0]] = 1;
+        return;
+    }
+
+    std::ranges::stable_sort(symbols, {}, [&](uint32_t symbol)
+                             { return frequencies[symbol]; });
+
+    // Two queues, the leaves in order and the internal nodes, which are
+    // created in order of their weight
+    struct Node
+    {
+        uint64_t weight;
+        std::size_t parent;
+    };
+
+    const auto leaf_count = symbols.size();
+    std::vector<Node> nodes;
+    nodes.reserve((2 * leaf_count) - 1);
+
+    for (const auto symbol : symbols)
+    {
+        nodes.push_back({.weight = frequencies[symbol], .parent = 0});
+    }
+
+    std::size_t next_leaf = 0;
+    std::size_t next_internal = leaf_count;
+
+    const auto take_smallest = [&]() -> std::size_t
+    {
+        if (next_leaf < leaf_count &&
+            (next_internal == nodes.size() ||
+             nodes[next_leaf].weight <= nodes[next_internal].weight))
+        {
+            return next_leaf++;
+        }
+
+        return next_internal++;
+    };
+
+    while (nodes.size() < (2 * leaf_count) - 1)
+    {
+        const auto first = take_smallest();
+        const auto second = take_smallest();
+        nodes[first].parent = nodes.size();
+        nodes[second].parent = nodes.size();
+        nodes.push_back(
+            {.weight = nodes[first].weight + nodes[second].weight,
+             .parent = 0});
+    }
+
+    // The root is last, every parent comes after its children
+    std::vector<uint32_t> depths(nodes.size(), 0);
+
+    for (auto i = nodes.size() - 1; i-- > 0;)
+    {
+        depths[i] = depths[nodes[i].parent] + 1;
+    }
+
+    std::array<uint32_t, 64> length_counts{};
+
+    for (std::size_t i = 0; i < leaf_count; i++)
+    {
+        length_counts[std::min(depths[i], max_length)]++;
+    }
+
+    // Clamping made the code overfull, lengthen codes until it's complete
+    uint64_t total = 0;
+
+    for (uint32_t length = 1; length <= max_length; length++)
+    {
+        total += static_cast<uint64_t>(length_counts[length])
+                 << (max_length - length);
+    }
+
+    while (total != (1ULL << max_length))
+    {
+        length_counts[max_length]--;
+
+        for (auto length = max_length - 1; length > 0; length--)
+        {
+            if (length_counts[length] != 0)
+            {
+                length_counts[length]--;
+                length_counts[length + 1] += 2;
+                break;
+            }
+        }
+
+        total--;
+    }
+
+    // The rarest symbols get the longest codes
+    std::size_t next_symbol = 0;
+
+    for (auto length = max_length; length > 0; length--)
+    {
+        for (uint32_t i = 0; i < length_counts[length]; i++)
+        {
+            lengths[symbols[next_symbol++]] = static_cast<uint8_t>(length);
+        }
+    }
+}
+
+// RFC 1951, 3.2.2
+auto BuildCodes(std::span<const uint8_t> lengths) -> std::vector<HuffmanCode>
+{
+    std::array<uint32_t, kMaxCodeLength + 1> length_counts{};
+
+    for (const auto length : lengths) { length_counts[length]++; }
+
+    length_counts[0] = 0;
+    std::array<uint32_t, kMaxCodeLength + 1> next_code{};
+    uint32_t code = 0;
+
+    for (uint32_t length = 1; length <= kMaxCodeLength; length++)
+    {
+        code = (code + length_counts[length - 1]) << 1U;
+        next_code[length] = code;
+    }
+
+    std::vector<HuffmanCode> codes(lengths.size(), {.bits = 0, .length = 0});
+
+    for (std::size_t i = 0; i < lengths.size(); i++)
+    {
+        if (lengths[i] == 0) { continue; }
+
+        codes[i] = {.bits = ReverseBits(next_code[lengths[i]]++, lengths[i]),
+                    .length = lengths[i]};
+    }
+
+    return codes;
+}
+
+class BitWriter
+{
+  public:
+    explicit BitWriter(std::vector<std::byte>& out) : mOut{out} {}
+
+    void Put(uint32_t bits, uint32_t count)
+    {
+        mBuffer |= static_cast<uint64_t>(bits) << mCount;
+        mCount += count;
+
+        while (mCount >= 8)
+        {
+            mOut.get().push_back(static_cast<std::byte>(mBuffer));
+            mBuffer >>= 8U;
+            mCount -= 8;
+        }
+    }
+
+    void Put(const HuffmanCode& code) { Put(code.bits, code.length); }
+
+    void AlignToByte() { Put(0, (8 - (mCount % 8)) % 8); }
+
+  private:
+    std::reference_wrapper<std::vector<std::byte>> mOut;
+    uint64_t mBuffer = 0;
+    uint32_t mCount = 0;
+};
+
+// A code length, or a repeat code with its extra bits
+struct CodeLengthToken
+{
+    uint8_t symbol;
+    uint8_t extra_bits;
+    uint8_t extra_bit_count;
+};
+
+// Run length encodes the code lengths with the codes 16, 17 and 18
+auto EncodeCodeLengths(std::span<const uint8_t> lengths)
+    -> std::vector<CodeLengthToken>
+{
+    std::vector<CodeLengthToken> tokens;
+
+    for (std::size_t i = 0; i < lengths.size();)
+    {
+        const auto length = lengths[i];
+        std::size_t run = 1;
+
+        while (i + run < lengths.size() && lengths[i + run] == length)
+        {
+            run++;
+        }
+
+        i += run;
+
+        if (length == 0)
+        {
+            while (run >= 11)
+            {
+                const auto count = std::min(run, 138UZ);
+                tokens.push_back({18, static_cast<uint8_t>(count - 11), 7});
+                run -= count;
+            }
+
+            if (run >= 3)
+            {
+                tokens.push_back({17, static_cast<uint8_t>(run - 3), 3});
+                run = 0;
+            }
+        }
+        else
+        {
+            tokens.push_back({length, 0, 0});
+            run--;
+
+            while (run >= 3)
+            {
+                const auto count = std::min(run, 6UZ);
+                tokens.push_back({16, static_cast<uint8_t>(count - 3), 2});
+                run -= count;
+            }
+        }
+
+        for (; run > 0; run--) { tokens.push_back({length, 0, 0}); }
+    }
+
+    return tokens;
+}
+
+void WriteStoredBlocks(std::span<const std::byte> input, BitWriter& writer)
+{
+    do
+    {
+        const auto size = std::min(input.size(), kMaxStoredBlockSize);
+        // Not the last block, no compression
+        writer.Put(0b000, 3);
+        writer.AlignToByte();
+        writer.Put(static_cast<uint32_t>(size), 16);
+        writer.Put(static_cast<uint32_t>(~size & 0xFFFFU), 16);
+
+        for (const auto byte : input.first(size))
+        {
+            writer.Put(static_cast<uint32_t>(byte), 8);
+        }
+
+        input = input.subspan(size);
+    } while (!input.empty());
+}
+
+// Writes the tokens, which encode 'input', as one block with Huffman codes
+// built for them. Stored as it is if that's smaller.
+void WriteBlock(std::span<const Token> tokens,
+                std::span<const std::byte> input, BitWriter& writer)
+{
+    std::array<uint32_t, kLiteralCount> literal_frequencies{};
+    std::array<uint32_t, kDistanceCount> distance_frequencies{};
+
+    for (const auto& token : tokens)
+    {
+        if (token.distance == 0) { literal_frequencies[token.length]++; }
+        else
+        {
+            literal_frequencies[kFirstLengthSymbol +
+                                kLengthSymbols[token.length]]++;
+            distance_frequencies[GetDistanceSymbol(token.distance)]++;
+        }
+    }
+
+    literal_frequencies[kEndOfBlock] = 1;
+
+    // Some decoders reject a code with a single symbol, two always work
+    const auto use_two_symbols = [](std::span<uint32_t> frequencies)
+    {
+        auto used_count = frequencies.size() -
+                          static_cast<std::size_t>(
+                              std::ranges::count(frequencies, 0U));
+
+        for (std::size_t i = 0; used_count < 2; i++)
+        {
+            if (frequencies[i] == 0)
+            {
+                frequencies[i] = 1;
+                used_count++;
+            }
+        }
+    };
+
+    use_two_symbols(literal_frequencies);
+    use_two_symbols(distance_frequencies);
+
+    std::array<uint8_t, kLiteralCount> literal_lengths{};
+    std::array<uint8_t, kDistanceCount> distance_lengths{};
+    BuildCodeLengths(literal_frequencies, kMaxCodeLength, literal_lengths);
+    BuildCodeLengths(distance_frequencies, kMaxCodeLength, distance_lengths);
+
+    std::size_t literal_count = kLiteralCount;
+    while (literal_lengths[literal_count - 1] == 0) { literal_count--; }
+    std::size_t distance_count = kDistanceCount;
+    while (distance_lengths[distance_count - 1] == 0) { distance_count--; }
+
+    std::vector<uint8_t> all_lengths(
+        literal_lengths.begin(),
+        literal_lengths.begin() + static_cast<std::ptrdiff_t>(literal_count));
+    all_lengths.insert(all_lengths.end(), distance_lengths.begin(),
+                       distance_lengths.begin() +
+                           static_cast<std::ptrdiff_t>(distance_count));
+    const auto length_tokens = EncodeCodeLengths(all_lengths);
+
+    std::array<uint32_t, kCodeLengthCount> code_length_frequencies{};
+    for (const auto& token : length_tokens)
+    {
+        code_length_frequencies[token.symbol]++;
+    }
+
+    std::array<uint8_t, kCodeLengthCount> code_length_lengths{};
+    BuildCodeLengths(code_length_frequencies, kMaxCodeLengthCodeLength,
+                     code_length_lengths);
+
+    std::size_t code_length_count = kCodeLengthCount;
+    while (code_length_count > 4 &&
+           code_length_lengths[kCodeLengthOrder[code_length_count - 1]] == 0)
+    {
+        code_length_count--;
+    }
+
+    // The size in bits, to compare with a stored block
+    uint64_t bit_count = 3 + 5 + 5 + 4 + (3 * code_length_count);
+
+    for (const auto& token : length_tokens)
+    {
+        bit_count += code_length_lengths[token.symbol] + token.extra_bit_count;
+    }
+
+    for (std::size_t i = 0; i < kLiteralCount; i++)
+    {
+        bit_count += static_cast<uint64_t>(literal_frequencies[i]) *
+                     literal_lengths[i];
+    }
+
+    for (std::size_t i = 0; i < kLengthExtraBits.size(); i++)
+    {
+        bit_count +=
+            static_cast<uint64_t>(literal_frequencies[kFirstLengthSymbol + i]) *
+            kLengthExtraBits[i];
+    }
+
+    for (std::size_t i = 0; i < kDistanceCount; i++)
+    {
+        bit_count += static_cast<uint64_t>(distance_frequencies[i]) *
+                     (distance_lengths[i] + kDistanceExtraBits[i]);
+    }
+
+    const auto stored_block_count =
+        std::max(1UZ, (input.size() + kMaxStoredBlockSize - 1) /
+                          kMaxStoredBlockSize);
+    const auto stored_bit_count =
+        ((input.size() + (5 * stored_block_count)) * 8) + 7;
+
+    if (stored_bit_count < bit_count)
+    {
+        WriteStoredBlocks(input, writer);
+        return;
+    }
+
+    const auto literal_codes = BuildCodes(literal_lengths);
+    const auto distance_codes = BuildCodes(distance_lengths);
+    const auto code_length_codes = BuildCodes(code_length_lengths);
+
+    // Not the last block, dynamic Huffman codes
+    writer.Put(0b100, 3);
+    writer.Put(static_cast<uint32_t>(literal_count - kFirstLengthSymbol), 5);
+    writer.Put(static_cast<uint32_t>(distance_count - 1), 5);
+    writer.Put(static_cast<uint32_t>(code_length_count - 4), 4);
+
+    for (std::size_t i = 0; i < code_length_count; i++)
+    {
+        writer.Put(code_length_lengths[kCodeLengthOrder[i]], 3);
+    }
+
+    for (const auto& token : length_tokens)
+    {
+        writer.Put(code_length_codes[token.symbol]);
+        writer.Put(token.extra_bits, token.extra_bit_count);
+    }
+
+    for (const auto& token : tokens)
+    {
+        if (token.distance == 0)
+        {
+            writer.Put(literal_codes[token.length]);
+            continue;
+        }
+
+        const auto length_symbol = kLengthSymbols[token.length];
+        writer.Put(literal_codes[kFirstLengthSymbol + length_symbol]);
+        writer.Put(static_cast<uint32_t>(token.length -
+                                         kLengthBase[length_symbol]),
+                   kLengthExtraBits[length_symbol]);
+
+        const auto distance_symbol = GetDistanceSymbol(token.distance);
+        writer.Put(distance_codes[distance_symbol]);
+        writer.Put(static_cast<uint32_t>(token.distance -
+                                         kDistanceBase[distance_symbol]),
+                   kDistanceExtraBits[distance_symbol]);
+    }
+
+    writer.Put(literal_codes[kEndOfBlock]);
+}
+
+// Compresses 'input' into whole deflate blocks, which end on a byte
+// boundary. The last segment ends the stream.
+auto CompressSegment(std::span<const std::byte> input, bool is_last)
+    -> std::vector<std::byte>
+{
+    std::vector<std::byte> out;
+    BitWriter writer{out};
+    const auto tokens = FindTokens(input);
+    std::size_t input_pos = 0;
+
+    for (std::size_t i = 0; i < tokens.size(); i += kMaxBlockTokens)
+    {
+        const auto block_tokens = std::span{tokens}.subspan(
+            i, std::min(kMaxBlockTokens, tokens.size() - i));
+        const auto block_size = std::accumulate(
+            block_tokens.begin(), block_tokens.end(), 0UZ,
+            [](std::size_t size, const Token& token)
+            { return size + (token.distance == 0 ? 1 : token.length); });
+
+        WriteBlock(block_tokens, input.subspan(input_pos, block_size),
+                   writer);
+        input_pos += block_size;
+    }
+
+    if (is_last)
+    {
+        // An empty last block, with the fixed codes, whose end of block
+        // code is 7 zero bits
+        writer.Put(0b011, 3);
+        writer.Put(0, 7);
+    }
+    else
+    {
+        // An empty stored block, which is how a flush aligns to a byte
+        writer.Put(0b000, 3);
+        writer.AlignToByte();
+        writer.Put(0x0000, 16);
+        writer.Put(0xFFFF, 16);
+    }
+
+    writer.AlignToByte();
+    return out;
+}
+} // namespace
+
+Deflater::Deflater()
+    : mBatchSize{kSegmentSize * ThreadPool::Get().GetConcurrency()}
+{
+}
+
+void Deflater::Write(std::span<const std::byte> data,
+                     std::vector<std::byte>& out)
+{
+    if (!mHasStarted)
+    {
+        // 32 KiB window, no preset dictionary, the check bits make the
+        // header a multiple of 31
+        out.push_back(std::byte{0x78});
+        out.push_back(std::byte{0x01});
+        mHasStarted = true;
+    }
+
+    for (std::size_t i = 0; i < data.size(); i += kAdlerBlockSize)
+    {
+        const auto block = data.subspan(
+            i, std::min(kAdlerBlockSize, data.size() - i));
+
+        for (const auto byte : block)
+        {
+            mAdlerA += static_cast<uint32_t>(byte);
+            mAdlerB += mAdlerA;
+        }
+
+        mAdlerA %= kAdlerModulo;
+        mAdlerB %= kAdlerModulo;
+    }
+
+    while (!data.empty())
+    {
+        const auto count = std::min(data.size(), mBatchSize - mPending.size());
+        mPending.insert(mPending.end(), data.begin(),
+                        data.begin() + static_cast<std::ptrdiff_t>(count));
+        data = data.subspan(count);
+
+        if (mPending.size() == mBatchSize) { CompressPending(false, out); }
+    }
+}
+
+void Deflater::Finish(std::vector<std::byte>& out)
+{
+    // Writes the header, for an empty stream
+    Write({}, out);
+    CompressPending(true, out);
+
+    const uint32_t adler = (mAdlerB << 16U) | mAdlerA;
+
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        out.push_back(static_cast<std::byte>(adler >> shift));
+    }
+}
+
+void Deflater::CompressPending(bool is_last, std::vector<std::byte>& out)
+{
+    // The last segment has to be there to end the stream, even if empty
+    const auto segment_count =
+        std::max(is_last ? 1UZ : 0UZ,
+                 (mPending.size() + kSegmentSize - 1) / kSegmentSize);
+    std::vector<std::vector<std::byte>> compressed(segment_count);
+
+    ThreadPool::Get().ParallelFor(
+        segment_count,
+        [&](std::size_t index)
+        {
+            const auto offset = index * kSegmentSize;
+            const auto segment = std::span{mPending}.subspan(
+                offset, std::min(kSegmentSize, mPending.size() - offset));
+            compressed[index] =
+                CompressSegment(segment, is_last && index == segment_count - 1);
+        });
+
+    for (const auto& segment : compressed)
+    {
+        out.insert(out.end(), segment.begin(), segment.end());
+    }
+
+    mPending.clear();
+}
+} // namespace Pikzel
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace Pikzel
+{
+// Compresses a stream into the zlib format, as PNG wants it, without
+// having all of it in memory. The input is cut into segments which are
+// compressed independently of each other, a batch of them at once on the
+// thread pool. Each segment ends on a byte boundary, so their outputs just
+// follow each other.
+//
+// It's tuned for pixel art. Runs of the same byte or the same pixel are
+// looked for before the hash chains, and every block gets Huffman codes
+// built for it, which are short when there are few colors.
+class Deflater
+{
+  public:
+    Deflater();
+    Deflater(const Deflater&) = delete;
+    Deflater(Deflater&&) = delete;
+    auto operator=(const Deflater&) -> Deflater& = delete;
+    auto operator=(Deflater&&) -> Deflater& = delete;
+    ~Deflater() = default;
+
+    // Appends what's been compressed so far to 'out'. The input is held
+    // until there's a whole batch of segments.
+    void Write(std::span<const std::byte> data, std::vector<std::byte>& out);
+    // Compresses what's left and ends the stream
+    void Finish(std::vector<std::byte>& out);
+
+  private:
+    void CompressPending(bool is_last, std::vector<std::byte>& out);
+
+    // Matches can't reach into the segment before, so a bigger one
+    // compresses slightly better but takes more memory per thread
+    static constexpr std::size_t kSegmentSize = 1024UZ * 1024;
+
+    std::vector<std::byte> mPending;
+    // A segment per thread
+    std::size_t mBatchSize;
+    uint32_t mAdlerA = 1;
+    uint32_t mAdlerB = 0;
+    bool mHasStarted = false;
+};
+} // namespace Pikzel
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "gla_base.hpp"
+
+#include <array>
+#include <cstddef>
+
+namespace Gla
+{
+// Guards the regions of a buffer the CPU writes to while the GPU may still be
+// reading from the other ones. Fence a region after the last command that
+// reads from it; Advance waits for the fence of the next region, which, with
+// three regions, was placed two frames ago and is already signaled.
+class FenceRing
+{
+  public:
+    static constexpr std::size_t kRegionCount = 3;
+
+    FenceRing() = default;
+    FenceRing(const FenceRing&) = delete;
+    FenceRing(FenceRing&&) = delete;
+    auto operator=(const FenceRing&) -> FenceRing& = delete;
+    auto operator=(FenceRing&&) -> FenceRing& = delete;
+    ~FenceRing() { Reset(); }
+
+    // Returns the index of the region that can be written to
+    auto Advance() -> std::size_t
+    {
+        mCurrent = (mCurrent + 1) % kRegionCount;
+        Wait(mFences.at(mCurrent));
+        return mCurrent;
+    }
+
+    void FenceCurrent()
+    {
+        auto& fence = mFences.at(mCurrent);
+        if (fence != nullptr) { GLCall(glDeleteSync(fence)); }
+        GLCall(fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    }
+
+    // Waits for all the regions and deletes the fences
+    void Reset()
+    {
+        for (auto& fence : mFences)
+        {
+            Wait(fence);
+            if (fence != nullptr) { GLCall(glDeleteSync(fence)); }
+            fence = nullptr;
+        }
+    }
+
+    [[nodiscard]] auto GetCurrent() const -> std::size_t { return mCurrent; }
+
+  private:
+    static void Wait(GLsync fence)
+    {
+        constexpr GLuint64 kTimeoutNs = 1'000'000;
+
+        if (fence == nullptr) { return; }
+
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                kTimeoutNs) == GL_TIMEOUT_EXPIRED)
+        {
+        }
+    }
+
+    std::array<GLsync, kRegionCount> mFences{};
+    std::size_t mCurrent = 0;
+};
+} // namespace Gla
@@ -5,6 +5,7 @@
 #include "frame_buffer.hpp"
 #include "group.hpp"
 #include "index_buffer.hpp"
+#include "pixel_buffer.hpp"
 #include "renderer.hpp"
 #include "shader.hpp"
 #include "texture.hpp"
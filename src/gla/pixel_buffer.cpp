@@ -0,0 +1,95 @@
+#include "pixel_buffer.hpp"
+
+#include <cassert>
+
+namespace Gla
+{
+PixelUnpackBuffer::PixelUnpackBuffer(std::size_t region_size)
+    : mRendererID(0), mSize(region_size),
+      mPersistent(GLEW_ARB_buffer_storage != 0)
+{
+    constexpr GLbitfield kFlags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    GLCall(glGenBuffers(1, &mRendererID));
+    GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mRendererID));
+
+    if (mPersistent)
+    {
+        const auto storage_size = mSize * FenceRing::kRegionCount;
+        GLCall(glBufferStorage(GL_PIXEL_UNPACK_BUFFER, storage_size, nullptr,
+                               kFlags));
+        GLCall(mMappedData = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                              storage_size, kFlags));
+    }
+    else
+    {
+        GLCall(glBufferData(GL_PIXEL_UNPACK_BUFFER, mSize, nullptr,
+                            GL_STREAM_DRAW));
+    }
+
+    GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+}
+
+PixelUnpackBuffer::~PixelUnpackBuffer()
+{
+    mFences.Reset();
+
+    if (mMappedData != nullptr)
+    {
+        Bind();
+        GLCall(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+    }
+
+    GLCall(glDeleteBuffers(1, &mRendererID));
+}
+
+auto PixelUnpackBuffer::BeginStreamWrite() -> void*
+{
+    Bind();
+
+    if (mPersistent)
+    {
+        const auto region = mFences.Advance();
+        return static_cast<std::byte*>(mMappedData) + (region * mSize);
+    }
+
+    // Orphans the old storage, so the driver never waits for uploads that are
+    // still reading from it
+    GLCall(void* ptr = glMapBufferRange(
+               GL_PIXEL_UNPACK_BUFFER, 0, mSize,
+               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+
+    return ptr;
+}
+
+void PixelUnpackBuffer::EndStreamWrite() const
+{
+    Bind();
+
+    // The mapping is coherent, so there's nothing to flush
+    if (mPersistent) { return; }
+
+    GLCall(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+}
+
+void PixelUnpackBuffer::FenceStreamRegion()
+{
+    if (mPersistent) { mFences.FenceCurrent(); }
+}
+
+auto PixelUnpackBuffer::GetStreamRegionOffset() const -> std::size_t
+{
+    return mPersistent ? mFences.GetCurrent() * mSize : 0;
+}
+
+void PixelUnpackBuffer::Bind() const
+{
+    GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mRendererID));
+}
+
+void PixelUnpackBuffer::Unbind()
+{
+    GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+}
+} // namespace Gla
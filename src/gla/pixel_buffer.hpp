@@ -0,0 +1,47 @@
+#pragma once
+
+#include "fence_ring.hpp"
+#include "gla_base.hpp"
+
+namespace Gla
+{
+// Staging buffer for texture uploads. While it's bound, the data pointer passed
+// to Texture2D::UpdateData is an offset into this buffer.
+//
+// The storage is split into FenceRing::kRegionCount regions which stay mapped
+// for the lifetime of the buffer, so streaming pixels never maps/unmaps nor
+// stalls on the GPU. Without ARB_buffer_storage there is a single region which
+// is orphaned and mapped on every write.
+class PixelUnpackBuffer
+{
+  public:
+    PixelUnpackBuffer(const PixelUnpackBuffer&) = delete;
+    PixelUnpackBuffer(PixelUnpackBuffer&&) = delete;
+    auto operator=(const PixelUnpackBuffer&) -> PixelUnpackBuffer& = delete;
+    auto operator=(PixelUnpackBuffer&&) -> PixelUnpackBuffer& = delete;
+    explicit PixelUnpackBuffer(std::size_t region_size);
+    ~PixelUnpackBuffer();
+
+    // Binds the buffer and returns the memory of the next region, which stays
+    // the current one until the next call. Write at most the region size.
+    [[nodiscard]] auto BeginStreamWrite() -> void*;
+    void EndStreamWrite() const;
+    // Call after the last upload that reads from the current region
+    void FenceStreamRegion();
+    // Offset of the current region in bytes
+    [[nodiscard]] auto GetStreamRegionOffset() const -> std::size_t;
+
+    void Bind() const;
+    static void Unbind();
+
+    // Returns the size of one region
+    [[nodiscard]] inline auto GetSize() const -> std::size_t { return mSize; }
+
+  private:
+    unsigned int mRendererID;
+    std::size_t mSize; // In bytes
+    bool mPersistent;
+    void* mMappedData = nullptr;
+    FenceRing mFences;
+};
+} // namespace Gla
@@ -9,9 +9,10 @@ void Renderer::DrawElements(DrawMode draw_mode, unsigned int indices_count,
     GLCall(glDrawElements(draw_mode, indices_count, type, indices));
 }
 
-void Renderer::DrawArrays(DrawMode draw_mode, std::size_t vertices_count)
+void Renderer::DrawArrays(DrawMode draw_mode, std::size_t vertices_count,
+                          std::size_t first_vertex /*= 0*/)
 {
-    GLCall(glDrawArrays(draw_mode, 0, vertices_count));
+    GLCall(glDrawArrays(draw_mode, first_vertex, vertices_count));
 }
 
 void Renderer::Clear()
@@ -19,7 +19,8 @@ class Renderer
                              const void* indices = nullptr,
                              GLenum type = GL_UNSIGNED_INT);
     // use for drawing without index buffer
-    static void DrawArrays(DrawMode draw_mode, std::size_t vertices_count);
+    static void DrawArrays(DrawMode draw_mode, std::size_t vertices_count,
+                           std::size_t first_vertex = 0);
     static void Clear();
     static void Flush();
 };
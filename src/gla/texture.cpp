@@ -139,6 +139,24 @@ Texture2D::Texture2D(const std::string& path,
     if (mLocalBuffer != nullptr) { stbi_image_free(mLocalBuffer); }
 }
 
+Texture2D::Texture2D(int width, int height,
+                     GLMinMagFilter texture_min_filter /*= kNearest*/)
+    : mLocalBuffer(nullptr), mWidth(width), mHeight(height), mBPP(4)
+{
+    GLCall(glGenTextures(1, &mRendererID));
+    GLCall(glBindTexture(GL_TEXTURE_2D, mRendererID));
+
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                           texture_min_filter));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+
+    GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, mWidth, mHeight, 0,
+                        GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+    GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
 Texture2D::~Texture2D()
 {
     GLCall(glDeleteTextures(1, &mRendererID));
@@ -154,4 +172,14 @@ void Texture2D::Unbind() const
 {
     GLCall(glBindTexture(GL_TEXTURE_2D, 0));
 }
+
+void Texture2D::UpdateData(int x_offset, int y_offset, int width, int height,
+                           const void* data, int row_length /*= 0*/) const
+{
+    GLCall(glBindTexture(GL_TEXTURE_2D, mRendererID));
+    GLCall(glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length));
+    GLCall(glTexSubImage2D(GL_TEXTURE_2D, 0, x_offset, y_offset, width, height,
+                           GL_RGBA, GL_UNSIGNED_BYTE, data));
+    GLCall(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+}
 } // namespace Gla
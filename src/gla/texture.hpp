@@ -57,10 +57,17 @@ class Texture2D : public Texture
     explicit Texture2D(const std::string& path,
                        GLMinMagFilter texture_min_filter = kLinear,
                        bool flip_vertically = false);
+    // Creates an empty RGBA8 texture, meant to be filled with UpdateData
+    Texture2D(int width, int height,
+              GLMinMagFilter texture_min_filter = kNearest);
     ~Texture2D() override;
 
     void Bind(unsigned int slot = 0) const override;
     void Unbind() const override;
+    // Data is expected to be RGBA8 rows 'row_length' pixels apart, tightly
+    // packed if it's 0. Binds the texture.
+    void UpdateData(int x_offset, int y_offset, int width, int height,
+                    const void* data, int row_length = 0) const;
 
     [[nodiscard]] inline auto GetWidth() const -> int { return mWidth; }
     [[nodiscard]] inline auto GetHeight() const -> int { return mHeight; }
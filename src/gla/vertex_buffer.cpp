@@ -1,5 +1,8 @@
 #include "vertex_buffer.hpp"
 
+#include <algorithm>
+#include <cassert>
+
 namespace Gla
 {
 VertexBuffer::VertexBuffer(const void* data, std::size_t size,
@@ -11,8 +14,31 @@ VertexBuffer::VertexBuffer(const void* data, std::size_t size,
     GLCall(glBufferData(GL_ARRAY_BUFFER, size, data, usage));
 }
 
+VertexBuffer::VertexBuffer(PersistentStreamTag /*unused*/,
+                           std::size_t region_size)
+    : mRendererID(0), mSize(region_size), mUsage(kStreamDraw),
+      mStreaming(true), mPersistent(GLEW_ARB_buffer_storage != 0),
+      mFences(std::make_shared<FenceRing>())
+{
+    if (mPersistent)
+    {
+        CreatePersistentStorage();
+        return;
+    }
+
+    GLCall(glGenBuffers(1, &mRendererID));
+    GLCall(glBindBuffer(GL_ARRAY_BUFFER, mRendererID));
+    GLCall(glBufferData(GL_ARRAY_BUFFER, mSize, nullptr, mUsage));
+}
+
 VertexBuffer::~VertexBuffer()
 {
+    if (mMappedData != nullptr)
+    {
+        Bind();
+        GLCall(glUnmapBuffer(GL_ARRAY_BUFFER));
+    }
+
     GLCall(glDeleteBuffers(1, &mRendererID));
 }
 
@@ -37,14 +63,64 @@ void VertexBuffer::UpdateData(const void* data, std::size_t size,
 
 void VertexBuffer::UpdateSize(std::size_t size) // Deletes existing data
 {
+    mSize = size;
+
+    if (mPersistent)
+    {
+        CreatePersistentStorage();
+        return;
+    }
+
     Bind();
     GLCall(glBufferData(GL_ARRAY_BUFFER, size, nullptr, mUsage));
-    mSize = size;
 }
 
-void VertexBuffer::UpdateSizeIfNeeded(std::size_t needed_size)
+auto VertexBuffer::UpdateSizeIfNeeded(std::size_t needed_size) -> bool
 {
-    if (needed_size > mSize) { UpdateSize(needed_size); }
+    if (needed_size > mSize)
+    {
+        UpdateSize(needed_size);
+        return true;
+    }
+
+    return false;
+}
+
+auto VertexBuffer::BeginStreamWrite() -> void*
+{
+    assert(mStreaming);
+
+    if (!mPersistent)
+    {
+        mStagingData.resize(mSize);
+        return mStagingData.data();
+    }
+
+    const auto region = mFences->Advance();
+    return static_cast<std::byte*>(mMappedData) + (region * mSize);
+}
+
+void VertexBuffer::EndStreamWrite(std::size_t written_size)
+{
+    assert(mStreaming && written_size <= mSize);
+
+    // The mapping is coherent, so there's nothing to flush
+    if (mPersistent) { return; }
+
+    UpdateData(mStagingData.data(), written_size);
+}
+
+void VertexBuffer::FenceStreamRegion()
+{
+    assert(mStreaming);
+
+    if (mPersistent) { mFences->FenceCurrent(); }
+}
+
+auto VertexBuffer::GetStreamRegionOffset() const -> std::size_t
+{
+    assert(mStreaming);
+    return mPersistent ? mFences->GetCurrent() * mSize : 0;
 }
 
 void VertexBuffer::Bind() const
@@ -56,4 +132,29 @@ void VertexBuffer::Unbind()
 {
     GLCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
 }
+
+void VertexBuffer::CreatePersistentStorage()
+{
+    constexpr GLbitfield kFlags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    // The GPU could still be reading from the old storage
+    mFences->Reset();
+
+    if (mRendererID != 0)
+    {
+        Bind();
+        GLCall(glUnmapBuffer(GL_ARRAY_BUFFER));
+        GLCall(glDeleteBuffers(1, &mRendererID));
+    }
+
+    const auto storage_size = std::max<std::size_t>(mSize, 1) *
+                              FenceRing::kRegionCount;
+
+    GLCall(glGenBuffers(1, &mRendererID));
+    GLCall(glBindBuffer(GL_ARRAY_BUFFER, mRendererID));
+    GLCall(glBufferStorage(GL_ARRAY_BUFFER, storage_size, nullptr, kFlags));
+    GLCall(mMappedData = glMapBufferRange(GL_ARRAY_BUFFER, 0, storage_size,
+                                          kFlags));
+}
 } // namespace Gla
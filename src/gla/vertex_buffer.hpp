@@ -1,7 +1,11 @@
 #pragma once
 
+#include "fence_ring.hpp"
 #include "gla_base.hpp"
 
+#include <memory>
+#include <vector>
+
 namespace Gla
 {
 enum VertexBufferUsage
@@ -11,6 +15,13 @@ enum VertexBufferUsage
     kDynamicDraw = GL_DYNAMIC_DRAW
 };
 
+struct PersistentStreamTag
+{
+    explicit PersistentStreamTag() = default;
+};
+
+inline constexpr PersistentStreamTag kPersistentStream{};
+
 class VertexBuffer
 {
   public:
@@ -20,21 +31,52 @@ class VertexBuffer
     auto operator=(VertexBuffer&&) -> VertexBuffer& = delete;
     VertexBuffer(const void* data, std::size_t size,
                  VertexBufferUsage usage = kStaticDraw);
+    // Streaming mode. The buffer gets immutable storage split into
+    // FenceRing::kRegionCount regions of 'region_size' bytes which stay
+    // mapped, so writing never maps/unmaps nor waits for the GPU. Falls back
+    // to glBufferSubData uploads if ARB_buffer_storage isn't available.
+    VertexBuffer(PersistentStreamTag, std::size_t region_size);
     ~VertexBuffer();
 
     void UpdateData(const void* data, std::size_t size,
                     std::size_t offset = 0) const;
+    // In streaming mode sets the region size. The storage is immutable, so
+    // a new buffer gets created and the vertex array has to add it again.
     void UpdateSize(std::size_t size);
-    void UpdateSizeIfNeeded(std::size_t needed_size);
+    // Returns true if the size got updated
+    auto UpdateSizeIfNeeded(std::size_t needed_size) -> bool;
+
+    // Streaming mode only. Returns the memory of the next region, which stays
+    // the current one until the next call. Write at most the region size.
+    [[nodiscard]] auto BeginStreamWrite() -> void*;
+    void EndStreamWrite(std::size_t written_size);
+    // Call after the last draw call that reads from the current region
+    void FenceStreamRegion();
+    // Offset of the current region in bytes
+    [[nodiscard]] auto GetStreamRegionOffset() const -> std::size_t;
 
     void Bind() const;
     static void Unbind();
 
+    // In streaming mode returns the size of one region
     [[nodiscard]] inline auto GetSize() const -> std::size_t { return mSize; }
+    [[nodiscard]] inline auto IsStreaming() const -> bool
+    {
+        return mStreaming;
+    }
 
   private:
+    void CreatePersistentStorage();
+
     unsigned int mRendererID;
     std::size_t mSize; // In bytes
     VertexBufferUsage mUsage;
+
+    bool mStreaming = false;
+    bool mPersistent = false;
+    void* mMappedData = nullptr;
+    std::shared_ptr<FenceRing> mFences;
+    // Used instead of the mapping if the persistent storage isn't supported
+    std::vector<std::byte> mStagingData;
 };
 } // namespace Gla
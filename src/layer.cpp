@@ -18,74 +18,10 @@
 
 namespace Pikzel
 {
-auto Color::operator=(const ImVec4& color) -> Color&
-{
-    r = static_cast<uint8_t>(color.x * 255);
-    g = static_cast<uint8_t>(color.y * 255);
-    b = static_cast<uint8_t>(color.z * 255);
-    a = static_cast<uint8_t>(color.w * 255);
-    return *this;
-}
-
-auto Color::operator==(const Color& other) const -> bool
-{
-    return other.r == r && other.g == g && other.b == b && other.a == a;
-}
-
-auto Color::operator==(const ImVec4& other) const -> bool
-{
-    constexpr float kTolerance = 0.0025F;
-
-    return std::abs((static_cast<float>(r) / 0xff) - other.x) <= kTolerance &&
-           std::abs((static_cast<float>(g) / 0xff) - other.y) <= kTolerance &&
-           std::abs((static_cast<float>(b) / 0xff) - other.z) <= kTolerance &&
-           std::abs((static_cast<float>(a) / 0xff) - other.w) <= kTolerance;
-}
-
-auto Color::BlendColor(Color color1, Color color2) -> Color
-{
-    ImVec4 col1 = {
-        static_cast<float>(color1.r) / 255,
-        static_cast<float>(color1.g) / 255,
-        static_cast<float>(color1.b) / 255,
-        static_cast<float>(color1.a) / 255,
-    };
-
-    ImVec4 col2 = {
-        static_cast<float>(color2.r) / 255,
-        static_cast<float>(color2.g) / 255,
-        static_cast<float>(color2.b) / 255,
-        static_cast<float>(color2.a) / 255,
-    };
-
-    float alpha1 = col1.w;
-    float alpha2 = col2.w;
-    float out_alpha = alpha1 + (alpha2 * (1.0F - alpha1));
-
-    if (out_alpha == 0) { return {.r = 0, .g = 0, .b = 0, .a = 0}; }
-
-    float out_r =
-        (col1.x * alpha1 + col2.x * alpha2 * (1.0F - alpha1)) / out_alpha;
-    float out_g =
-        (col1.y * alpha1 + col2.y * alpha2 * (1.0F - alpha1)) / out_alpha;
-    float out_b =
-        (col1.z * alpha1 + col2.z * alpha2 * (1.0F - alpha1)) / out_alpha;
-
-    return Color::FromImVec4({out_r, out_g, out_b, out_alpha});
-}
-
-auto Color::FromImVec4(const ImVec4 color) -> Color
-{
-    return {.r = static_cast<uint8_t>(color.x * 0xff),
-            .g = static_cast<uint8_t>(color.y * 0xff),
-            .b = static_cast<uint8_t>(color.z * 0xff),
-            .a = static_cast<uint8_t>(color.w * 0xff)};
-}
-
 Layer::Layer(Tool& tool, Camera& camera, Vec2Int canvas_dims,
              bool is_canvas_layer /*= true*/,
              bool draw_visible_pixels_only /*= false*/) noexcept
-    : mCanvas{static_cast<std::size_t>(canvas_dims.x * canvas_dims.y)},
+    : mCanvas{canvas_dims, is_canvas_layer}, mId{sNextId++},
       mCanvasDims{canvas_dims}, mIsCanvasLayer{is_canvas_layer},
       mDrawVisiblePixelsOnly{draw_visible_pixels_only},
       mLayerName{"Layer " + std::to_string(sConstructCounter)}, mTool{tool},
@@ -246,8 +182,7 @@ auto Layer::HandleBucket() -> Layer::ShouldUpdateHistory
     if (!canv_coord.has_value()) { return false; }
 
     Color clicked_color = GetPixel(canv_coord.value());
-    Fill(canv_coord->x, canv_coord->y, clicked_color);
-    return true;
+    return !Fill(canv_coord->x, canv_coord->y, clicked_color).IsEmpty();
 }
 
 auto Layer::HandleRectShape() -> Layer::ShouldUpdateHistory
@@ -315,11 +250,16 @@ void Layer::DrawPixel(Vec2Int coords)
 
 void Layer::DrawPixel(Vec2Int coords, Color color)
 {
-    std::unique_lock<std::mutex> lock{sMutex};
-    mCanvas[(coords.y * mCanvasDims.x) + coords.x] = color;
-    lock.unlock();
+    mCanvas.SetPixel(coords, color);
+    MarkDirty({.upper_left = coords, .bottom_right = coords + 1});
+}
 
-    if (mIsCanvasLayer) { GetDirtyPixels().push_back(coords); }
+void Layer::MarkDirty(Rect rect)
+{
+    if (!mIsCanvasLayer) { return; }
+
+    mDirtyRect.Include(rect);
+    mCompositeDirtyRect.Include(rect);
 }
 
 void Layer::DrawPixelClampCoords(Vec2Int coords, Color color)
@@ -398,13 +338,8 @@ void Layer::DrawCircle(Vec2Int center, int radius, bool fill,
 
 void Layer::Clear()
 {
-    for (int i = 0; i < mCanvasDims.y; i++)
-    {
-        for (int j = 0; j < mCanvasDims.x; j++)
-        {
-            DrawPixel({j, i}, {.r = 0, .g = 0, .b = 0, .a = 0});
-        }
-    }
+    mCanvas.Clear();
+    MarkDirty({.upper_left = {0, 0}, .bottom_right = mCanvasDims});
 }
 
 void Layer::DrawRect(Vec2Int upper_left, Vec2Int bottom_right, bool /*fill*/)
@@ -587,46 +522,75 @@ void Layer::DrawLine(Vec2Int point_a, Vec2Int point_b,
     }
 }
 
-void Layer::Fill(int x_coord, int y_coord, Color clicked_color)
+auto Layer::Fill(int x_coord, int y_coord, Color clicked_color) -> Rect
 {
-    Fill(x_coord, y_coord, clicked_color,
-         Color::FromImVec4(mTool.get().GetColor()));
+    return Fill(x_coord, y_coord, clicked_color,
+                Color::FromImVec4(mTool.get().GetColor()));
 }
 
-void Layer::Fill(int x_coord, int y_coord, Color clicked_color,
-                 Color fill_color)
+auto Layer::Fill(int x_coord, int y_coord, Color clicked_color,
+                 Color fill_color) -> Rect
 {
     if (x_coord < 0 || x_coord >= mCanvasDims.x || y_coord < 0 ||
-        y_coord >= mCanvasDims.y)
+        y_coord >= mCanvasDims.y || clicked_color == fill_color)
     {
-        return;
+        return {};
     }
 
-    std::queue<std::pair<int, int>> pixel_queue;
-    pixel_queue.emplace(y_coord, x_coord);
+    auto pixel_at = [&](int col, int row) -> Color
+    { return mCanvas.GetPixel({col, row}); };
 
-    while (!pixel_queue.empty())
+    // Seeds of the spans which still have to be filled. A seed is pushed once
+    // per run of fillable pixels above and below a filled span, so the stack
+    // stays small even for huge areas.
+    std::vector<Vec2Int> seeds;
+    seeds.emplace_back(x_coord, y_coord);
+    Rect filled;
+
+    while (!seeds.empty())
     {
-        auto& top = pixel_queue.front();
-        const int row = top.first;
-        const int col = top.second;
-        Color pixel = GetPixel({col, row});
+        const auto seed = seeds.back();
+        seeds.pop_back();
 
-        if (pixel == clicked_color && pixel != fill_color)
+        if (pixel_at(seed.x, seed.y) != clicked_color) { continue; }
+
+        int left = seed.x;
+        int right = seed.x + 1; // Exclusive
+
+        while (left > 0 && pixel_at(left - 1, seed.y) == clicked_color)
         {
-            DrawPixel({col, row}, fill_color);
+            left--;
+        }
 
-            if (col + 1 < mCanvasDims.x) { pixel_queue.emplace(row, col + 1); }
+        while (right < mCanvasDims.x &&
+               pixel_at(right, seed.y) == clicked_color)
+        {
+            right++;
+        }
 
-            if (col - 1 >= 0) { pixel_queue.emplace(row, col - 1); }
+        mCanvas.FillRow(seed.y, left, right, fill_color);
+        filled.Include(Rect{.upper_left = {left, seed.y},
+                            .bottom_right = {right, seed.y + 1}});
 
-            if (row + 1 < mCanvasDims.y) { pixel_queue.emplace(row + 1, col); }
+        for (const int row : {seed.y - 1, seed.y + 1})
+        {
+            if (row < 0 || row >= mCanvasDims.y) { continue; }
 
-            if (row - 1 >= 0) { pixel_queue.emplace(row - 1, col); }
-        }
+            bool in_run = false;
 
-        pixel_queue.pop();
+            for (int col = left; col < right; col++)
+            {
+                const bool fillable = pixel_at(col, row) == clicked_color;
+
+                if (fillable && !in_run) { seeds.emplace_back(col, row); }
+
+                in_run = fillable;
+            }
+        }
     }
+
+    MarkDirty(filled);
+    return filled;
 }
 
 void Layer::FillUntil(Color until_color, int x_coord, int y_coord,
@@ -729,12 +693,4 @@ auto Layer::ClampToCanvasDims(Vec2Int val_to_clamp) -> Vec2Int
 {
     return glm::clamp(val_to_clamp, {0, 0}, mCanvasDims - 1);
 }
-
-// Should call this func before VertexBufferControl::Update, since it needs
-// dirty pixels
-void Layer::ResetDirtyPixelData()
-{
-    sShouldUpdateWholeVBO = false;
-    GetDirtyPixels().clear();
-}
 } // namespace Pikzel
@@ -1,14 +1,17 @@
 #pragma once
 
 #include "camera.hpp"
+#include "color.hpp"
 #include "project.hpp"
+#include "rect.hpp"
+#include "tiled_canvas.hpp"
 #include "tool.hpp"
 
 #include <imgui.h>
 
-#include <mutex>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace Pikzel
@@ -16,18 +19,6 @@ namespace Pikzel
 constexpr int kCanvasHeight = 32;
 constexpr int kCanvasWidth = 32;
 
-struct Color
-{
-    auto operator=(const ImVec4& color) -> Color&;
-    auto operator==(const Color& other) const -> bool;
-    auto operator==(const ImVec4& other) const -> bool;
-
-    static auto BlendColor(Color color1, Color color2) -> Color;
-    static auto FromImVec4(ImVec4 color) -> Color;
-
-    uint8_t r = 0, g = 0, b = 0, a = 0;
-};
-
 struct Vertex
 {
     float pos_x{}, pos_y{};
@@ -55,7 +46,11 @@ class Layer
                          bool use_color_alpha = false) const;
     void Update();
 
-    void SwitchVisibilityState() { mVisible = !mVisible; }
+    void SwitchVisibilityState()
+    {
+        mVisible = !mVisible;
+        InvalidateComposite();
+    }
     void SwitchLockState() { mLocked = !mLocked; }
 
     [[nodiscard]] auto IsVisible() const -> bool { return mVisible; }
@@ -67,14 +62,16 @@ class Layer
     }
     [[nodiscard]] auto GetPixel(Vec2Int coords) const -> Color
     {
-        std::lock_guard<std::mutex> lock{sMutex};
-        return mCanvas[(coords.y * mCanvasDims.x) + coords.x];
+        return mCanvas.GetPixel(coords);
     }
-    [[nodiscard]] auto GetCanvas() const -> const CanvasData&
+    [[nodiscard]] auto GetCanvas() const -> const TiledCanvas&
     {
         return mCanvas;
     }
     [[nodiscard]] auto GetCanvasDims() const -> Vec2Int { return mCanvasDims; }
+    // Unique for every layer created, copies keep it. The undo history uses
+    // it to find the layer a change belongs to.
+    [[nodiscard]] auto GetId() const -> std::size_t { return mId; }
     [[nodiscard]] auto IsPreviewLayer() const -> bool
     {
         return !mIsCanvasLayer;
@@ -85,13 +82,35 @@ class Layer
     [[nodiscard]]
     auto CanvasCoordsFromCursorPos() const -> std::optional<Vec2Int>;
     auto ClampToCanvasDims(Vec2Int val_to_clamp) -> Vec2Int;
-    static void ResetDirtyPixelData();
-    static void SetUpdateWholeVBOToTrue() { sShouldUpdateWholeVBO = true; }
-    static auto ShouldUpdateWholeVBO() -> bool { return sShouldUpdateWholeVBO; }
-    static auto GetDirtyPixels() -> std::vector<Vec2Int>&
+    static void ResetUpdateWholeCanvas() { sShouldUpdateWholeCanvas = false; }
+    static void SetUpdateWholeCanvasToTrue()
+    {
+        sShouldUpdateWholeCanvas = true;
+    }
+    static auto ShouldUpdateWholeCanvas() -> bool
+    {
+        return sShouldUpdateWholeCanvas;
+    }
+    // Bounding rect of the pixels drawn since the last call
+    auto TakeDirtyRect() -> Rect { return std::exchange(mDirtyRect, {}); }
+    // Same as TakeDirtyRect, but tracked separately for the flattened canvas
+    // kept by Layers. Covers the whole layer after an opacity or visibility
+    // change.
+    auto TakeCompositeDirtyRect() -> Rect
+    {
+        return std::exchange(mCompositeDirtyRect, {});
+    }
+    // Call after changing the opacity
+    void InvalidateComposite()
+    {
+        mCompositeDirtyRect = {.upper_left = {0, 0},
+                               .bottom_right = mCanvasDims};
+    }
+    // Copies the pixels inside of the rect to 'dst', row by row, with no
+    // padding in between the rows
+    void CopyRectTo(Rect rect, Color* dst) const
     {
-        static std::vector<Vec2Int> dirty_pixels;
-        return dirty_pixels;
+        mCanvas.CopyRectTo(rect, dst);
     }
 
     static void ResetConstructCounter() { sConstructCounter = 1; }
@@ -106,6 +125,7 @@ class Layer
     void HandleColorPicker();
     auto HandleBucket() -> ShouldUpdateHistory;
     auto HandleRectShape() -> ShouldUpdateHistory;
+    void MarkDirty(Rect rect);
     void DrawPixel(Vec2Int coords);
     void DrawPixel(Vec2Int coords, Color color);
     void DrawPixelClampCoords(Vec2Int coords, Color color);
@@ -116,12 +136,18 @@ class Layer
                   std::optional<Color> color = std::nullopt);
     void DrawLine(Vec2Int point_a, Vec2Int point_b,
                   std::optional<Color> color = std::nullopt);
-    void Fill(int x_coord, int y_coord, Color clicked_color);
-    void Fill(int x_coord, int y_coord, Color clicked_color, Color fill_color);
+    // Scanline fill of the area of 'clicked_color' pixels connected to the
+    // given coords. Returns the bounding box of the filled pixels.
+    auto Fill(int x_coord, int y_coord, Color clicked_color) -> Rect;
+    auto Fill(int x_coord, int y_coord, Color clicked_color, Color fill_color)
+        -> Rect;
     void FillUntil(Color until_color, int x_coord, int y_coord,
                    Color fill_color);
 
-    CanvasData mCanvas;
+    TiledCanvas mCanvas;
+    std::size_t mId;
+    Rect mDirtyRect;
+    Rect mCompositeDirtyRect;
     RectShapeData mHandleRectShapeData;
     Vec2Int mCanvasDims;
     bool mIsCanvasLayer;
@@ -133,13 +159,15 @@ class Layer
     std::reference_wrapper<Tool> mTool;
     std::reference_wrapper<Camera> mCamera;
 
-    inline static std::mutex sMutex;
     inline static int sConstructCounter = 1;
-    inline static bool sShouldUpdateWholeVBO = true;
+    inline static std::size_t sNextId = 0;
+    inline static bool sShouldUpdateWholeCanvas = true;
 
     friend class UI;
     friend class Layers;
     friend class PreviewLayer;
     friend void Project::Open(const std::string&);
+    friend auto Project::OpenAutosave(const std::string&) -> bool;
+    friend auto Project::ImportQoi(const std::string&) -> bool;
 };
 } // namespace Pikzel
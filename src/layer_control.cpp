@@ -1,21 +1,138 @@
 #include "layer_control.hpp"
+#include "blend.hpp"
+#include "compression.hpp"
 #include "events.hpp"
 #include "layer.hpp"
-#include "vertex_buffer_control.hpp"
+#include "thread_pool.hpp"
 
 #include "GLFW/glfw3.h"
 #include <cstddef>
 #include <glm/geometric.hpp>
 
 #include <algorithm>
-#include <array>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
 #include <list>
 #include <ranges>
+#include <span>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace Pikzel
 {
+namespace
+{
+// The before and after tile of every tile change, in the order they're
+// stored when the node gets compressed
+auto GatherTileHandles(const Layers::Capture& capture)
+    -> std::vector<TiledCanvas::TileHandle>
+{
+    std::vector<TiledCanvas::TileHandle> tiles;
+
+    for (const auto& layer_change : capture.layer_changes)
+    {
+        for (const auto& tile : layer_change.tiles)
+        {
+            tiles.push_back(tile.before);
+            tiles.push_back(tile.after);
+        }
+    }
+
+    return tiles;
+}
+
+// Every tile is stored as its compressed size, 4 bytes, followed by the
+// compressed pixels. The empty tile is stored as size 0.
+auto CompressTiles(const std::vector<TiledCanvas::TileHandle>& tiles)
+    -> std::vector<std::byte>
+{
+    std::vector<std::byte> compressed;
+
+    for (const auto& tile : tiles)
+    {
+        const std::size_t size_pos = compressed.size();
+        compressed.resize(size_pos + sizeof(uint32_t));
+
+        if (tile != TiledCanvas::GetEmptyTile())
+        {
+            Compression::Compress(std::as_bytes(std::span{*tile}), compressed);
+        }
+
+        const auto size = static_cast<uint32_t>(compressed.size() - size_pos -
+                                                sizeof(uint32_t));
+        std::memcpy(&compressed[size_pos], &size, sizeof(size));
+    }
+
+    compressed.shrink_to_fit();
+    return compressed;
+}
+
+// Fails, leaving 'capture' as it was, if 'compressed' is cut short or
+// doesn't decompress
+auto DecompressTiles(Layers::Capture& capture,
+                     std::span<const std::byte> compressed) -> bool
+{
+    std::size_t pos = 0;
+
+    // Null if it fails
+    auto next_tile = [&compressed, &pos]() -> TiledCanvas::TileHandle
+    {
+        uint32_t size = 0;
+
+        if (compressed.size() - pos < sizeof(size)) { return nullptr; }
+
+        std::memcpy(&size, &compressed[pos], sizeof(size));
+        pos += sizeof(size);
+
+        if (size == 0) { return TiledCanvas::GetEmptyTile(); }
+
+        if (compressed.size() - pos < size) { return nullptr; }
+
+        auto tile = std::make_shared<TiledCanvas::Tile>();
+
+        if (!Compression::Decompress(compressed.subspan(pos, size),
+                                     std::as_writable_bytes(std::span{*tile})))
+        {
+            return nullptr;
+        }
+
+        pos += size;
+        return tile;
+    };
+
+    // Before and after of every tile, in order
+    std::vector<TiledCanvas::TileHandle> tiles;
+
+    for (const auto& layer_change : capture.layer_changes)
+    {
+        for (std::size_t i = 0; i < layer_change.tiles.size() * 2; i++)
+        {
+            tiles.push_back(next_tile());
+
+            if (tiles.back() == nullptr) { return false; }
+        }
+    }
+
+    if (pos != compressed.size()) { return false; }
+
+    auto iter = tiles.begin();
+
+    for (auto& layer_change : capture.layer_changes)
+    {
+        for (auto& tile : layer_change.tiles)
+        {
+            tile.before = std::move(*iter++);
+            tile.after = std::move(*iter++);
+        }
+    }
+
+    return true;
+}
+} // namespace
 
 auto Layers::GetCurrentLayer() -> Layer&
 {
@@ -33,12 +150,19 @@ auto Layers::GetCanvasDims() const -> Vec2Int
 
 void Layers::DoCurrentTool()
 {
+    // Everything drawn while the button is held is one command
+    if (Events::IsMouseButtonPressed(Events::MouseButtons::kButtonLeft))
+    {
+        mIsToolTransactionOpen = true;
+    }
+
     if (GetCurrentLayer().DoCurrentTool()) { MarkHistoryForUpdate(); }
 }
 
 void Layers::AddLayer(Tool& tool, Camera& camera)
 {
-    mCurrentCapture->layers.emplace_back(tool, camera, mCanvasDims);
+    BeginStructureChange();
+    GetLayers().emplace_back(tool, camera, mCanvasDims);
     MarkHistoryForUpdate();
 }
 
@@ -46,11 +170,14 @@ void Layers::MoveUp(std::size_t layer_index)
 {
     if (layer_index == 0) { return; }
 
+    BeginStructureChange();
     auto it1 = GetLayers().begin();
     std::advance(it1, layer_index);
     auto it2 = GetLayers().begin();
     std::advance(it2, layer_index - 1);
     std::iter_swap(it1, it2);
+    InvalidateWholeCanvas();
+    MarkHistoryForUpdate();
 
     if (mCurrentLayerIndex == layer_index) { mCurrentLayerIndex--; }
     else if (mCurrentLayerIndex == layer_index - 1) { mCurrentLayerIndex++; }
@@ -60,73 +187,19 @@ void Layers::MoveDown(std::size_t layer_index)
 {
     if (layer_index >= GetLayers().size() - 1) { return; }
 
+    BeginStructureChange();
     auto it1 = GetLayers().begin();
     std::advance(it1, layer_index);
     auto it2 = GetLayers().begin();
     std::advance(it2, layer_index + 1);
     std::iter_swap(it1, it2);
+    InvalidateWholeCanvas();
+    MarkHistoryForUpdate();
 
     if (mCurrentLayerIndex == layer_index) { mCurrentLayerIndex++; }
     else if (mCurrentLayerIndex == layer_index + 1) { mCurrentLayerIndex--; }
 }
 
-void Layers::EmplaceVertices(std::vector<Vertex>& vertices) const
-{
-    vertices.clear();
-
-    for (const auto& layer : GetLayers())
-    {
-        layer.EmplaceVertices(vertices);
-    }
-}
-
-void Layers::EmplaceBckgVertices(std::vector<Vertex>& vertices,
-                                 std::optional<Vec2Int> custom_dims) const
-{
-    constexpr std::array<Color, 2> kBgColors = {
-        Color{.r = 131, .g = 131, .b = 131, .a = 255},
-        Color{.r = 201, .g = 201, .b = 201, .a = 255}};
-
-    if (!custom_dims.has_value()) { custom_dims.emplace(GetCanvasDims()); }
-    assert(custom_dims.has_value());
-
-    auto canvas_width = custom_dims->x;
-    auto canvas_height = custom_dims->y;
-
-    for (int i = 0; i < canvas_height; i += 6)
-    {
-        for (int j = 0; j < canvas_width; j += 6)
-        {
-            auto x_coord = static_cast<float>(j);
-            auto y_coord = static_cast<float>(i);
-            glm::vec2 dims = *custom_dims;
-
-            // upper left corner
-            vertices.emplace_back(x_coord, y_coord,
-                                  kBgColors.at(((i + j) / 6) % 2));
-            // upper right corner
-            vertices.emplace_back(std::clamp(x_coord + 6, 0.0F, dims.x),
-                                  y_coord, kBgColors.at(((i + j) / 6) % 2));
-            // bottom left corner
-            vertices.emplace_back(x_coord,
-                                  std::clamp(y_coord + 6, 0.0F, dims.y),
-                                  kBgColors.at(((i + j) / 6) % 2));
-            /* second triangle */
-            // upper right corner
-            vertices.emplace_back(std::clamp(x_coord + 6, 0.0F, dims.x),
-                                  y_coord, kBgColors.at(((i + j) / 6) % 2));
-            // bottom right corner
-            vertices.emplace_back(std::clamp(x_coord + 6, 0.0F, dims.x),
-                                  std::clamp(y_coord + 6, 0.0F, dims.y),
-                                  kBgColors.at(((i + j) / 6) % 2));
-            // bottom left corner
-            vertices.emplace_back(x_coord,
-                                  std::clamp(y_coord + 6, 0.0F, dims.y),
-                                  kBgColors.at(((i + j) / 6) % 2));
-        }
-    }
-}
-
 auto Layers::AtIndex(std::size_t index) -> Layer&
 {
     assert(index >= 0 && index < GetLayers().size());
@@ -143,67 +216,197 @@ void Layers::ResetDataToDefault()
     mCurrentLayerIndex = 0;
 }
 
-auto Layers::GetDisplayedCanvas() const -> CanvasData
+auto Layers::GetDisplayedCanvas() -> const CanvasData&
 {
-    auto canvas_width = GetCanvasDims().x;
-    auto canvas_height = GetCanvasDims().y;
+    for (auto& layer : GetLayers())
+    {
+        mFlattenedDirtyRect.Include(layer.TakeCompositeDirtyRect());
+    }
 
-    CanvasData displayed_canvas{
-        static_cast<std::size_t>(canvas_height * canvas_width)};
+    CompositeRect(std::exchange(mFlattenedDirtyRect, {}));
+    return mFlattenedCanvas;
+}
+
+void Layers::CompositeRect(Rect rect)
+{
+    // Works tile by tile, the same tiles the layers are stored in. A tile of
+    // the result and of the layer being blended into it stay in the cache.
+    constexpr int kTileSize = TiledCanvas::kTileSize;
+
+    if (rect.IsEmpty()) { return; }
 
-    for (const auto& layer_traversed : std::ranges::reverse_view(GetLayers()))
+    const auto canvas_width = static_cast<std::size_t>(GetCanvasDims().x);
+    const int first_tile_x = rect.upper_left.x / kTileSize;
+    const int first_tile_y = rect.upper_left.y / kTileSize;
+    const int tiles_per_row =
+        ((rect.bottom_right.x - 1) / kTileSize) - first_tile_x + 1;
+    const int tiles_per_col =
+        ((rect.bottom_right.y - 1) / kTileSize) - first_tile_y + 1;
+
+    // Tiles don't overlap, so they can be blended without any locking
+    auto composite_tile = [&](std::size_t index)
     {
-        for (int i = 0; i < canvas_height; i++)
+        const Vec2Int tile_coords{
+            (first_tile_x + static_cast<int>(index % tiles_per_row)) *
+                kTileSize,
+            (first_tile_y + static_cast<int>(index / tiles_per_row)) *
+                kTileSize};
+        const Rect part = Intersect(
+            rect, {.upper_left = tile_coords,
+                   .bottom_right = tile_coords + kTileSize});
+        const auto part_width = static_cast<std::size_t>(part.Width());
+
+        for (int i = part.upper_left.y; i < part.bottom_right.y; i++)
         {
-            for (int j = 0; j < canvas_width; j++)
+            std::fill_n(
+                &mFlattenedCanvas[(i * canvas_width) + part.upper_left.x],
+                part_width, Color{});
+        }
+
+        for (const auto& layer : std::ranges::reverse_view(GetLayers()))
+        {
+            if (!layer.IsVisible() || layer.GetOpacity() == 0) { continue; }
+
+            const auto& canvas = layer.GetCanvas();
+            const auto tile_index = canvas.TileIndexOf(tile_coords);
+
+            // Blending a transparent tile changes nothing
+            if (canvas.IsTileEmpty(tile_index)) { continue; }
+
+            const auto& tile = canvas.GetTile(tile_index);
+            const auto opacity = static_cast<uint8_t>(layer.mOpacity);
+
+            for (int i = part.upper_left.y; i < part.bottom_right.y; i++)
             {
-                Color pixel = layer_traversed.GetPixel({j, i});
-
-                Color dst_color = {
-                    .r = pixel.r,
-                    .g = pixel.g,
-                    .b = pixel.b,
-                    .a = pixel.a == 0
-                             ? pixel.a
-                             : static_cast<uint8_t>(layer_traversed.mOpacity)};
-
-                displayed_canvas[(i * canvas_width) + j] = Color::BlendColor(
-                    dst_color, displayed_canvas[(i * canvas_width) + j]);
+                const Vec2Int row_begin{part.upper_left.x, i};
+                BlendRowOver(
+                    &mFlattenedCanvas[(i * canvas_width) + row_begin.x],
+                    &tile[TiledCanvas::PixelIndexInTile(row_begin)],
+                    part_width, opacity);
             }
         }
+    };
+
+    ThreadPool::Get().ParallelFor(
+        static_cast<std::size_t>(tiles_per_row) * tiles_per_col,
+        composite_tile);
+}
+
+void Layers::LoadAllTiles()
+{
+    std::vector<TiledCanvas*> canvases;
+
+    for (auto& layer : GetLayers()) { canvases.push_back(&layer.mCanvas); }
+
+    if (mPendingStructureBefore.has_value())
+    {
+        for (auto& layer : *mPendingStructureBefore)
+        {
+            canvases.push_back(&layer.mCanvas);
+        }
+    }
+
+    std::vector<Tree<Capture>*> nodes{mUndoTree.get()};
+
+    while (!nodes.empty())
+    {
+        auto* node = nodes.back();
+        nodes.pop_back();
+
+        for (auto& child : node->GetChildren())
+        {
+            nodes.push_back(child.get());
+        }
+
+        auto& structure_change = node->GetData().structure_change;
+        if (!structure_change.has_value()) { continue; }
+
+        for (auto* layers :
+             {&structure_change->before, &structure_change->after})
+        {
+            for (auto& layer : *layers) { canvases.push_back(&layer.mCanvas); }
+        }
     }
 
-    return displayed_canvas;
+    // Layer by layer, every one decodes only its own tiles
+    ThreadPool::Get().ParallelFor(canvases.size(), [&canvases](std::size_t i)
+                                  { canvases[i]->LoadAllTiles(); });
+}
+
+void Layers::InvalidateWholeCanvas()
+{
+    Layer::SetUpdateWholeCanvasToTrue();
+    mFlattenedDirtyRect = {.upper_left = {0, 0},
+                           .bottom_right = GetCanvasDims()};
 }
 
 void Layers::PushToHistory()
 {
-    assert(mCurrentCapture.has_value());
     assert(mCurrentUndoTreeNode != nullptr);
 
-    mCurrentUndoTreeNode = &mCurrentUndoTreeNode->AddChild(
-        mCurrentCapture->layers, mCurrentLayerIndex);
+    Capture capture{mCurrentLayerIndex};
+    capture.selected_layer_index_before =
+        mCurrentUndoTreeNode->GetData().selected_layer_index;
+
+    for (auto& layer : GetLayers())
+    {
+        auto tiles = layer.mCanvas.TakeChanges();
+
+        if (tiles.empty()) { continue; }
+
+        for (const auto& tile : tiles)
+        {
+            mChangedTiles.push_back(
+                {.layer_id = layer.GetId(), .tile_index = tile.tile_index});
+        }
+
+        capture.layer_changes.push_back(
+            {.layer_id = layer.GetId(), .tiles = std::move(tiles)});
+    }
+
+    if (mPendingStructureBefore.has_value())
+    {
+        capture.structure_change.emplace(
+            std::move(*mPendingStructureBefore), SnapshotLayers());
+        mPendingStructureBefore.reset();
+    }
+
+    capture.property_changes = GetPropertyChanges();
+
+    // Nothing really changed, like a fill with the color already there
+    if (capture.layer_changes.empty() && capture.property_changes.empty() &&
+        !capture.structure_change.has_value())
+    {
+        return;
+    }
+
+    capture.byte_size = GetCaptureByteSize(capture);
+    mHistoryByteSize += capture.byte_size;
+    SetCurrentUndoTreeNode(mCurrentUndoTreeNode->AddChild(std::move(capture)));
 }
 
 void Layers::Undo()
 {
-    assert(mCurrentCapture.has_value());
     assert(mCurrentUndoTreeNode != nullptr);
 
-    if (mCurrentUndoTreeNode->GetParent() == nullptr) { return; }
+    CommitPendingChanges();
 
-    mCurrentUndoTreeNode = mCurrentUndoTreeNode->GetParent();
-    mCurrentCapture.emplace(mCurrentUndoTreeNode->GetData());
-    mCurrentLayerIndex = mCurrentCapture->selected_layer_index;
-    VertexBufferControl::SetUpdateAllToTrue();
-    Layer::SetUpdateWholeVBOToTrue();
+    if (mCurrentUndoTreeNode->GetParent() == nullptr ||
+        !EnsureDecompressed(*mCurrentUndoTreeNode))
+    {
+        return;
+    }
+
+    ApplyBackward(mCurrentUndoTreeNode->GetData());
+    SetCurrentUndoTreeNode(*mCurrentUndoTreeNode->GetParent());
 }
 
 void Layers::Redo()
 {
-    assert(mCurrentCapture.has_value());
     assert(mCurrentUndoTreeNode != nullptr);
 
+    CommitPendingChanges();
+
     auto& children = mCurrentUndoTreeNode->GetChildren();
     std::size_t child_last_used_index =
         mCurrentUndoTreeNode->GetLastUsedNodeIndex();
@@ -214,28 +417,59 @@ void Layers::Redo()
     {
         std::puts("Incorrect behaviour in Layers::Redo for now. Using the "
                   "first child");
-        mCurrentUndoTreeNode = children.front().get();
-        mCurrentCapture.emplace(mCurrentUndoTreeNode->GetData());
-        VertexBufferControl::SetUpdateAllToTrue();
-        Layer::SetUpdateWholeVBOToTrue();
-        return;
+        child_last_used_index = 0;
     }
 
-    mCurrentUndoTreeNode = children[child_last_used_index].get();
-    mCurrentCapture.emplace(mCurrentUndoTreeNode->GetData());
-    mCurrentLayerIndex = mCurrentCapture->selected_layer_index;
-    VertexBufferControl::SetUpdateAllToTrue();
-    Layer::SetUpdateWholeVBOToTrue();
+    auto& child = *children[child_last_used_index];
+
+    if (!EnsureDecompressed(child)) { return; }
+
+    ApplyForward(child.GetData());
+    SetCurrentUndoTreeNode(child);
 }
 
 // NOTE: This doesn't set last used child id
 void Layers::SetCurrentNode(Tree<Capture>& node_to_set_to)
 {
-    mCurrentUndoTreeNode = &node_to_set_to;
-    mCurrentCapture.emplace(mCurrentUndoTreeNode->GetData());
-    mCurrentLayerIndex = mCurrentCapture->selected_layer_index;
-    VertexBufferControl::SetUpdateAllToTrue();
-    Layer::SetUpdateWholeVBOToTrue();
+    assert(mCurrentUndoTreeNode != nullptr);
+
+    CommitPendingChanges();
+
+    if (mCurrentUndoTreeNode == &node_to_set_to) { return; }
+
+    // Undoes up to the closest common ancestor, then redoes down to the node
+    std::vector<Tree<Capture>*> path_to_root;
+    for (auto* node = &node_to_set_to; node != nullptr;
+         node = node->GetParent())
+    {
+        path_to_root.push_back(node);
+    }
+
+    std::vector<Tree<Capture>*> to_undo;
+    auto* node = mCurrentUndoTreeNode;
+    while (std::ranges::find(path_to_root, node) == path_to_root.end())
+    {
+        to_undo.push_back(node);
+        node = node->GetParent();
+    }
+
+    std::vector<Tree<Capture>*> to_redo{
+        path_to_root.begin(), std::ranges::find(path_to_root, node)};
+    std::ranges::reverse(to_redo);
+
+    // Nothing is applied unless every node on the way can be
+    for (auto* step : {&to_undo, &to_redo})
+    {
+        for (auto* node_on_way : *step)
+        {
+            if (!EnsureDecompressed(*node_on_way)) { return; }
+        }
+    }
+
+    for (auto* node_on_way : to_undo) { ApplyBackward(node_on_way->GetData()); }
+    for (auto* node_on_way : to_redo) { ApplyForward(node_on_way->GetData()); }
+
+    SetCurrentUndoTreeNode(node_to_set_to);
 }
 
 void Layers::UpdateAndDraw(bool should_do_tool, Tool& tool, Camera& camera)
@@ -261,9 +495,25 @@ void Layers::UpdateAndDraw(bool should_do_tool, Tool& tool, Camera& camera)
 
     if (mShouldAddLayer) { AddLayer(tool, camera); }
 
-    if (mShouldUpdateHistory) { PushToHistory(); }
+    // Checked here and not in DoCurrentTool, the button can be released
+    // above the UI
+    if (mIsToolTransactionOpen &&
+        !Events::IsMouseButtonPressed(Events::MouseButtons::kButtonLeft))
+    {
+        mIsToolTransactionOpen = false;
+        MarkHistoryForUpdate();
+    }
+
+    if (mShouldUpdateHistory && !mIsToolTransactionOpen)
+    {
+        CommitPendingChanges();
+        mShouldUpdateHistory = false;
+    }
+
+    // Only here, so no node gets deleted while the UI points to it
+    EnforceHistoryBudget();
+    CompressColdNodes();
 
-    mShouldUpdateHistory = false;
     mShouldUndo = false;
     mShouldRedo = false;
     mShouldAddLayer = false;
@@ -271,8 +521,699 @@ void Layers::UpdateAndDraw(bool should_do_tool, Tool& tool, Camera& camera)
 
 void Layers::InitHistory(Camera& camera, Tool& tool)
 {
-    mCurrentCapture.emplace(tool, camera, mCanvasDims, 0);
-    mUndoTree.emplace(auto{mCurrentCapture.value()});
-    mCurrentUndoTreeNode = &(*mUndoTree);
+    GetLayers().clear();
+    GetLayers().emplace_back(tool, camera, mCanvasDims);
+    mPendingStructureBefore.reset();
+    mCompressionJobs.clear();
+    mLastCompressionScanNode = nullptr;
+
+    if (IsHistoryJournalEnabled()) { mHistoryJournal.Reset(); }
+
+    mUndoTree = std::make_unique<Tree<Capture>>(0UZ);
+    mHistoryByteSize = 0;
+    SetCurrentUndoTreeNode(*mUndoTree);
+    mFlattenedCanvas.assign(static_cast<std::size_t>(mCanvasDims.x) *
+                                static_cast<std::size_t>(mCanvasDims.y),
+                            Color{});
+    InvalidateWholeCanvas();
+}
+
+void Layers::SetHistoryBudget(std::size_t budget_in_bytes)
+{
+    mHistoryBudget = budget_in_bytes;
+    EnforceHistoryBudget();
+}
+
+auto Layers::EnableHistoryJournal(const std::string& path) -> bool
+{
+    if (!mHistoryJournal.Open(path)) { return false; }
+
+    EnforceHistoryBudget();
+    return true;
+}
+
+auto Layers::DisableHistoryJournal() -> bool
+{
+    if (!IsHistoryJournalEnabled()) { return true; }
+
+    std::vector<Tree<Capture>*> nodes{mUndoTree.get()};
+    std::vector<Capture*> read_back;
+    bool has_failed = false;
+
+    while (!nodes.empty())
+    {
+        auto* node = nodes.back();
+        nodes.pop_back();
+
+        for (auto& child : node->GetChildren())
+        {
+            nodes.push_back(child.get());
+        }
+
+        auto& capture = node->GetData();
+
+        if (!capture.is_compressed || !capture.compressed_tiles.empty())
+        {
+            read_back.push_back(&capture);
+            continue;
+        }
+
+        const auto compressed = mHistoryJournal.Read(*capture.journal_entry);
+
+        // Stays spilled
+        if (compressed.size() != capture.journal_entry->size)
+        {
+            has_failed = true;
+            continue;
+        }
+
+        capture.compressed_tiles.assign(compressed.begin(), compressed.end());
+        RecountByteSize(capture);
+        read_back.push_back(&capture);
+    }
+
+    // The nodes read back keep their entries, spilling them again just
+    // frees the memory
+    if (has_failed)
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't read the history back from the journal in "
+                     "Layers::DisableHistoryJournal, it's kept\n";
+#endif
+        EnforceHistoryBudget();
+        return false;
+    }
+
+    for (auto* capture : read_back) { capture->journal_entry.reset(); }
+
+    mHistoryJournal.Close();
+    EnforceHistoryBudget();
+    return true;
+}
+
+void Layers::SetCurrentUndoTreeNode(Tree<Capture>& node)
+{
+    mCurrentUndoTreeNode = &node;
+    node.GetData().last_visit = ++mVisitCounter;
+    SnapshotProperties();
+}
+
+auto Layers::GetPropertyChanges() const -> std::vector<Capture::PropertyChange>
+{
+    std::vector<Capture::PropertyChange> property_changes;
+
+    // Added and removed layers have theirs in the structure change
+    for (const auto& layer : GetLayers())
+    {
+        auto iter = std::ranges::find(
+            mNodeProperties, layer.GetId(),
+            &std::pair<std::size_t, Capture::LayerProperties>::first);
+
+        if (iter == mNodeProperties.end()) { continue; }
+
+        auto properties = GetProperties(layer);
+
+        if (properties == iter->second) { continue; }
+
+        property_changes.push_back({.layer_id = layer.GetId(),
+                                    .before = iter->second,
+                                    .after = std::move(properties)});
+    }
+
+    return property_changes;
+}
+
+void Layers::SnapshotProperties()
+{
+    mNodeProperties.clear();
+
+    for (const auto& layer : GetLayers())
+    {
+        mNodeProperties.emplace_back(layer.GetId(), GetProperties(layer));
+    }
+}
+
+auto Layers::GetProperties(const Layer& layer) -> Capture::LayerProperties
+{
+    return {.name = layer.mLayerName,
+            .opacity = layer.mOpacity,
+            .is_visible = layer.mVisible,
+            .is_locked = layer.mLocked};
+}
+
+void Layers::SetProperties(Layer& layer,
+                           const Capture::LayerProperties& properties)
+{
+    const bool changes_pixels = layer.mOpacity != properties.opacity ||
+                                layer.mVisible != properties.is_visible;
+
+    layer.mLayerName = properties.name;
+    layer.mOpacity = properties.opacity;
+    layer.mVisible = properties.is_visible;
+    layer.mLocked = properties.is_locked;
+
+    if (changes_pixels) { layer.InvalidateComposite(); }
+}
+
+void Layers::EnforceHistoryBudget()
+{
+    if (IsHistoryJournalEnabled()) { SpillToJournal(); }
+
+    while (mHistoryByteSize > mHistoryBudget &&
+           mCurrentUndoTreeNode != mUndoTree.get())
+    {
+        auto& children = mUndoTree->GetChildren();
+
+        if (children.size() > 1)
+        {
+            // Another branch than the one leading to the current node
+            std::optional<std::size_t> evicted;
+
+            for (std::size_t i = 0; i < children.size(); i++)
+            {
+                if (IsOnCurrentPath(*children[i])) { continue; }
+
+                if (!evicted.has_value() ||
+                    GetSubtreeLastVisit(*children[i]) <
+                        GetSubtreeLastVisit(*children[*evicted]))
+                {
+                    evicted = i;
+                }
+            }
+
+            assert(evicted.has_value());
+            CancelCompressions(*children[*evicted]);
+            mHistoryByteSize -= GetSubtreeByteSize(*children[*evicted]);
+            mUndoTree->RemoveChild(*evicted);
+            continue;
+        }
+
+        // The only child becomes the root. The root is never applied, so
+        // the changes of the new root aren't needed anymore.
+        mUndoTree = mUndoTree->ReleaseChild(0);
+        std::erase_if(mCompressionJobs, [this](const CompressionJob& job)
+                      { return job.node == mUndoTree.get(); });
+        auto& new_root = mUndoTree->GetData();
+        mHistoryByteSize -= new_root.byte_size;
+        new_root.byte_size = 0;
+        new_root.layer_changes.clear();
+        new_root.is_compressed = false;
+        new_root.compressed_tiles = {};
+        new_root.journal_entry.reset();
+        new_root.property_changes.clear();
+        new_root.structure_change.reset();
+    }
+}
+
+void Layers::SpillToJournal()
+{
+    if (mHistoryByteSize <= mHistoryBudget) { return; }
+
+    // Nodes with tiles in memory. The root and the current node are the
+    // ones applied the most, those stay.
+    std::vector<Tree<Capture>*> spillable;
+    std::vector<Tree<Capture>*> nodes{mUndoTree.get()};
+
+    while (!nodes.empty())
+    {
+        auto* node = nodes.back();
+        nodes.pop_back();
+
+        for (auto& child : node->GetChildren())
+        {
+            nodes.push_back(child.get());
+        }
+
+        const auto& capture = node->GetData();
+        const bool is_spilled =
+            capture.is_compressed && capture.compressed_tiles.empty();
+
+        if (node != mUndoTree.get() && node != mCurrentUndoTreeNode &&
+            !capture.layer_changes.empty() && !is_spilled)
+        {
+            spillable.push_back(node);
+        }
+    }
+
+    std::ranges::sort(spillable, {}, [](const Tree<Capture>* node)
+                      { return node->GetData().last_visit; });
+
+    for (auto* node : spillable)
+    {
+        if (mHistoryByteSize <= mHistoryBudget) { break; }
+
+        auto& capture = node->GetData();
+
+        // Nodes paged in before are still in the journal
+        if (!capture.journal_entry.has_value())
+        {
+            auto compressed =
+                capture.is_compressed
+                    ? std::move(capture.compressed_tiles)
+                    : CompressTiles(GatherTileHandles(capture));
+
+            capture.journal_entry = mHistoryJournal.Append(compressed);
+
+            if (!capture.journal_entry.has_value())
+            {
+                // Out of disk space, probably. Tried again next frame.
+                if (capture.is_compressed)
+                {
+                    capture.compressed_tiles = std::move(compressed);
+                }
+                return;
+            }
+        }
+
+        std::erase_if(mCompressionJobs, [node](const CompressionJob& job)
+                      { return job.node == node; });
+        ReleaseTiles(capture);
+        capture.compressed_tiles = {};
+        capture.is_compressed = true;
+        RecountByteSize(capture);
+    }
+}
+
+auto Layers::IsOnCurrentPath(const Tree<Capture>& node) const -> bool
+{
+    for (const auto* path_node = mCurrentUndoTreeNode; path_node != nullptr;
+         path_node = path_node->GetParent())
+    {
+        if (path_node == &node) { return true; }
+    }
+
+    return false;
+}
+
+void Layers::CompressColdNodes()
+{
+    StoreFinishedCompressions();
+
+    if (mLastCompressionScanNode == mCurrentUndoTreeNode) { return; }
+
+    mLastCompressionScanNode = mCurrentUndoTreeNode;
+
+    // Walks kColdNodeDistance steps from the current node, up and down
+    std::unordered_set<const Tree<Capture>*> warm_nodes{mCurrentUndoTreeNode};
+    std::vector<const Tree<Capture>*> frontier{mCurrentUndoTreeNode};
+
+    for (std::size_t distance = 0; distance < kColdNodeDistance; distance++)
+    {
+        std::vector<const Tree<Capture>*> next_frontier;
+
+        auto visit = [&](const Tree<Capture>* node)
+        {
+            if (node != nullptr && warm_nodes.insert(node).second)
+            {
+                next_frontier.push_back(node);
+            }
+        };
+
+        for (const auto* node : frontier)
+        {
+            visit(node->GetParent());
+            for (const auto& child : node->GetChildren())
+            {
+                visit(child.get());
+            }
+        }
+
+        frontier = std::move(next_frontier);
+    }
+
+    std::unordered_set<const Tree<Capture>*> pending_nodes;
+    for (const auto& job : mCompressionJobs)
+    {
+        pending_nodes.insert(job.node);
+    }
+
+    std::vector<Tree<Capture>*> nodes{mUndoTree.get()};
+
+    while (!nodes.empty())
+    {
+        auto* node = nodes.back();
+        nodes.pop_back();
+
+        for (auto& child : node->GetChildren())
+        {
+            nodes.push_back(child.get());
+        }
+
+        const auto& capture = node->GetData();
+
+        if (capture.is_compressed || capture.layer_changes.empty() ||
+            warm_nodes.contains(node) || pending_nodes.contains(node))
+        {
+            continue;
+        }
+
+        // The job holds its own handles, so the tiles can't be written to
+        // while it reads them, they're cloned on write
+        auto result = std::make_shared<std::vector<std::byte>>();
+        auto done = ThreadPool::Get().Submit(
+            [result, tiles = GatherTileHandles(capture)]
+            { *result = CompressTiles(tiles); });
+
+        mCompressionJobs.push_back(
+            {.node = node, .result = result, .done = std::move(done)});
+    }
+}
+
+void Layers::StoreFinishedCompressions()
+{
+    std::erase_if(
+        mCompressionJobs,
+        [this](const CompressionJob& job)
+        {
+            if (job.done.wait_for(std::chrono::seconds{0}) !=
+                std::future_status::ready)
+            {
+                return false;
+            }
+
+            auto& capture = job.node->GetData();
+            ReleaseTiles(capture);
+            capture.compressed_tiles = std::move(*job.result);
+            capture.is_compressed = true;
+            RecountByteSize(capture);
+            return true;
+        });
+}
+
+auto Layers::EnsureDecompressed(Tree<Capture>& node) -> bool
+{
+    // Not waited for, the job just finishes unseen
+    std::erase_if(mCompressionJobs, [&node](const CompressionJob& job)
+                  { return job.node == &node; });
+
+    auto& capture = node.GetData();
+
+    if (!capture.is_compressed) { return true; }
+
+    std::span<const std::byte> compressed = capture.compressed_tiles;
+
+    // Spilled to the journal
+    if (compressed.empty() && capture.journal_entry.has_value())
+    {
+        compressed = mHistoryJournal.Read(*capture.journal_entry);
+    }
+
+    if (!DecompressTiles(capture, compressed))
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't read back a node of the undo history in "
+                     "Layers::EnsureDecompressed\n";
+#endif
+        return false;
+    }
+
+    capture.compressed_tiles = {};
+    capture.is_compressed = false;
+    RecountByteSize(capture);
+    return true;
+}
+
+void Layers::CancelCompressions(const Tree<Capture>& node)
+{
+    std::erase_if(mCompressionJobs,
+                  [&node](const CompressionJob& job)
+                  {
+                      for (const auto* ancestor = job.node; ancestor != nullptr;
+                           ancestor = ancestor->GetParent())
+                      {
+                          if (ancestor == &node) { return true; }
+                      }
+
+                      return false;
+                  });
+}
+
+void Layers::ReleaseTiles(Capture& capture)
+{
+    for (auto& layer_change : capture.layer_changes)
+    {
+        for (auto& tile : layer_change.tiles)
+        {
+            tile.before.reset();
+            tile.after.reset();
+        }
+    }
+}
+
+void Layers::RecountByteSize(Capture& capture)
+{
+    mHistoryByteSize -= capture.byte_size;
+    capture.byte_size = GetCaptureByteSize(capture);
+    mHistoryByteSize += capture.byte_size;
+}
+
+auto Layers::GetCaptureByteSize(const Capture& capture) -> std::size_t
+{
+    // Tiles created by the command. The ones from before belong to the
+    // parent node or to the document the history started with.
+    std::size_t byte_size = sizeof(Tree<Capture>) + sizeof(Capture);
+
+    for (const auto& layer_change : capture.layer_changes)
+    {
+        byte_size += sizeof(layer_change) +
+                     (layer_change.tiles.size() *
+                      sizeof(TiledCanvas::TileChange));
+
+        if (capture.is_compressed) { continue; }
+
+        for (const auto& tile : layer_change.tiles)
+        {
+            if (tile.after != TiledCanvas::GetEmptyTile())
+            {
+                byte_size += sizeof(TiledCanvas::Tile);
+            }
+        }
+    }
+
+    byte_size += capture.compressed_tiles.capacity();
+
+    for (const auto& property_change : capture.property_changes)
+    {
+        byte_size += sizeof(property_change) +
+                     property_change.before.name.capacity() +
+                     property_change.after.name.capacity();
+    }
+
+    if (capture.structure_change.has_value())
+    {
+        for (const auto* layers : {&capture.structure_change->before,
+                                   &capture.structure_change->after})
+        {
+            for (const auto& layer : *layers)
+            {
+                byte_size += sizeof(Layer) +
+                             (layer.GetCanvas().GetTileCount() *
+                              sizeof(TiledCanvas::TileHandle));
+            }
+        }
+    }
+
+    return byte_size;
+}
+
+auto Layers::GetSubtreeByteSize(const Tree<Capture>& node) -> std::size_t
+{
+    std::size_t byte_size = 0;
+    std::vector<const Tree<Capture>*> nodes{&node};
+
+    // Not recursive, the history can easily be thousands of nodes deep
+    while (!nodes.empty())
+    {
+        const auto* traversed = nodes.back();
+        nodes.pop_back();
+        byte_size += traversed->GetData().byte_size;
+
+        for (const auto& child : traversed->GetChildren())
+        {
+            nodes.push_back(child.get());
+        }
+    }
+
+    return byte_size;
+}
+
+auto Layers::GetSubtreeLastVisit(const Tree<Capture>& node) -> std::size_t
+{
+    std::size_t last_visit = 0;
+    std::vector<const Tree<Capture>*> nodes{&node};
+
+    while (!nodes.empty())
+    {
+        const auto* traversed = nodes.back();
+        nodes.pop_back();
+        last_visit = std::max(last_visit, traversed->GetData().last_visit);
+
+        for (const auto& child : traversed->GetChildren())
+        {
+            nodes.push_back(child.get());
+        }
+    }
+
+    return last_visit;
+}
+
+void Layers::BeginStructureChange()
+{
+    if (!mPendingStructureBefore.has_value())
+    {
+        mPendingStructureBefore.emplace(SnapshotLayers());
+    }
+}
+
+void Layers::CommitPendingChanges()
+{
+    const bool has_pixel_changes = std::ranges::any_of(
+        GetLayers(), [](const Layer& layer)
+        { return layer.mCanvas.HasChanges(); });
+
+    if (has_pixel_changes || mPendingStructureBefore.has_value() ||
+        !GetPropertyChanges().empty())
+    {
+        PushToHistory();
+    }
+}
+
+void Layers::DiscardPendingChanges()
+{
+    for (auto& layer : GetLayers()) { layer.mCanvas.ForgetChanges(); }
+
+    mPendingStructureBefore.reset();
+    SnapshotProperties();
+}
+
+void Layers::ApplyBackward(const Capture& capture)
+{
+    for (const auto& layer_change : capture.layer_changes)
+    {
+        auto* layer = FindLayer(layer_change.layer_id);
+        assert(layer != nullptr);
+
+        for (const auto& tile : layer_change.tiles)
+        {
+            SetTile(*layer, tile.tile_index, tile.before);
+        }
+    }
+
+    if (capture.structure_change.has_value())
+    {
+        ApplyStructure(capture.structure_change->before);
+    }
+
+    for (const auto& property_change : capture.property_changes)
+    {
+        auto* layer = FindLayer(property_change.layer_id);
+        assert(layer != nullptr);
+        SetProperties(*layer, property_change.before);
+    }
+
+    mCurrentLayerIndex = std::min(capture.selected_layer_index_before,
+                                  GetLayers().size() - 1);
+}
+
+void Layers::ApplyForward(const Capture& capture)
+{
+    if (capture.structure_change.has_value())
+    {
+        ApplyStructure(capture.structure_change->after);
+    }
+
+    for (const auto& layer_change : capture.layer_changes)
+    {
+        auto* layer = FindLayer(layer_change.layer_id);
+        assert(layer != nullptr);
+
+        for (const auto& tile : layer_change.tiles)
+        {
+            SetTile(*layer, tile.tile_index, tile.after);
+        }
+    }
+
+    for (const auto& property_change : capture.property_changes)
+    {
+        auto* layer = FindLayer(property_change.layer_id);
+        assert(layer != nullptr);
+        SetProperties(*layer, property_change.after);
+    }
+
+    mCurrentLayerIndex =
+        std::min(capture.selected_layer_index, GetLayers().size() - 1);
+}
+
+void Layers::ApplyStructure(const std::vector<Layer>& structure)
+{
+    std::list<Layer> layers;
+
+    // Layers which still exist keep their pixels, those come from the tile
+    // changes. Only the removed ones are recreated from the structure.
+    for (const auto& layer : structure)
+    {
+        auto iter =
+            std::ranges::find(GetLayers(), layer.GetId(), &Layer::GetId);
+
+        if (iter != GetLayers().end())
+        {
+            layers.splice(layers.end(), GetLayers(), iter);
+        }
+        else
+        {
+            // Its tiles are new to the document, the ones never drawn on
+            // aside
+            const auto& canvas = layers.emplace_back(layer).GetCanvas();
+
+            for (std::size_t i = 0; i < canvas.GetTileCount(); i++)
+            {
+                if (canvas.IsTileEmpty(i)) { continue; }
+
+                mChangedTiles.push_back(
+                    {.layer_id = layer.GetId(), .tile_index = i});
+            }
+        }
+    }
+
+    GetLayers() = std::move(layers);
+
+    // Layer textures go by index, so a reorder changes every one of them
+    InvalidateWholeCanvas();
+}
+
+void Layers::SetTile(Layer& layer, std::size_t tile_index,
+                     const TiledCanvas::TileHandle& handle)
+{
+    // The same handle means the same pixels, nothing to upload
+    if (layer.mCanvas.GetTileHandle(tile_index) == handle) { return; }
+
+    layer.mCanvas.SetTileHandle(tile_index, handle);
+    layer.MarkDirty(layer.mCanvas.GetTileRect(tile_index));
+    mChangedTiles.push_back(
+        {.layer_id = layer.GetId(), .tile_index = tile_index});
+}
+
+auto Layers::TakeChangedTiles() -> std::vector<ChangedTile>
+{
+    std::ranges::sort(mChangedTiles);
+    const auto duplicates = std::ranges::unique(mChangedTiles);
+    mChangedTiles.erase(duplicates.begin(), duplicates.end());
+
+    return std::exchange(mChangedTiles, {});
+}
+
+auto Layers::FindLayer(std::size_t layer_id) -> Layer*
+{
+    auto iter = std::ranges::find(GetLayers(), layer_id, &Layer::GetId);
+    return iter != GetLayers().end() ? &*iter : nullptr;
+}
+
+auto Layers::SnapshotLayers() const -> std::vector<Layer>
+{
+    std::vector<Layer> snapshot{GetLayers().begin(), GetLayers().end()};
+
+    for (auto& layer : snapshot) { layer.mCanvas.ForgetChanges(); }
+
+    return snapshot;
 }
 } // namespace Pikzel
@@ -3,15 +3,21 @@
 #include "GLFW/glfw3.h"
 #include "camera.hpp"
 #include "layer.hpp"
+#include "tiled_canvas.hpp"
 #include "project.hpp"
 #include "tool.hpp"
 #include "tree.hpp"
+#include "undo_journal.hpp"
 
 #include <imgui.h>
 
+#include <cstddef>
+#include <future>
 #include <list>
+#include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace Pikzel
@@ -19,25 +25,79 @@ namespace Pikzel
 class Layers
 {
   public:
+    // One node of the undo tree. Instead of a copy of the document it holds
+    // only what the command changed, so it can be applied in both directions.
     struct Capture
     {
-        Capture(Tool& tool, Camera& camera, Vec2Int canvas_dims,
-                std::size_t selected_layer_ind)
-            : time_of_creation{static_cast<int>(glfwGetTime())},
-              selected_layer_index{selected_layer_ind}
+        struct LayerChange
         {
-            layers.emplace_back(tool, camera, canvas_dims);
-        }
+            std::size_t layer_id;
+            std::vector<TiledCanvas::TileChange> tiles;
+        };
+
+        // What a layer has besides its pixels
+        struct LayerProperties
+        {
+            std::string name;
+            int opacity;
+            bool is_visible;
+            bool is_locked;
+
+            auto operator==(const LayerProperties&) const -> bool = default;
+        };
+
+        struct PropertyChange
+        {
+            std::size_t layer_id;
+            LayerProperties before;
+            LayerProperties after;
+        };
 
-        Capture(std::list<Layer>& layers, std::size_t selected_layer_index)
-            : time_of_creation{static_cast<int>(glfwGetTime())}, layers{layers},
-              selected_layer_index{selected_layer_index}
+        // Layers added or moved. The layers themselves are kept, which is
+        // cheap since they share their tiles with the document.
+        struct StructureChange
+        {
+            std::vector<Layer> before;
+            std::vector<Layer> after;
+        };
+
+        explicit Capture(std::size_t selected_layer_ind)
+            : time_of_creation{static_cast<int>(glfwGetTime())},
+              selected_layer_index{selected_layer_ind},
+              selected_layer_index_before{selected_layer_ind}
         {
         }
 
         int time_of_creation;
-        std::list<Layer> layers;
+        // Memory the node keeps alive, counted once when it's pushed
+        std::size_t byte_size = 0;
+        // When the node was last the current one, bigger is more recent
+        std::size_t last_visit = 0;
+        std::vector<LayerChange> layer_changes;
+        // Set for nodes far from the current one. The tiles of all the layer
+        // changes, before and after, are in 'compressed_tiles' then and
+        // their handles are null.
+        bool is_compressed = false;
+        std::vector<std::byte> compressed_tiles;
+        // Where the compressed tiles are in the history journal. If they're
+        // only there, 'compressed_tiles' is empty.
+        std::optional<UndoJournal::Entry> journal_entry;
+        // Of the layers there before and after, the ones which keep their
+        // id through the structure change
+        std::vector<PropertyChange> property_changes;
+        std::optional<StructureChange> structure_change;
         std::size_t selected_layer_index;
+        std::size_t selected_layer_index_before;
+    };
+
+    // A tile whose pixels changed in the document, by a new node or by
+    // moving through the history
+    struct ChangedTile
+    {
+        std::size_t layer_id;
+        std::size_t tile_index;
+
+        auto operator<=>(const ChangedTile&) const = default;
     };
 
     auto GetCurrentLayer() -> Layer&;
@@ -47,20 +107,20 @@ class Layers
     void MoveUp(std::size_t layer_index);
     void MoveDown(std::size_t layer_index);
     void AddLayer(Tool& tool, Camera& camera);
-    void EmplaceVertices(std::vector<Vertex>& vertices) const;
-    void EmplaceBckgVertices(std::vector<Vertex>& vertices,
-                             std::optional<Vec2Int> custom_dims) const;
     void ResetDataToDefault();
     void DrawToTempLayer();
     auto AtIndex(std::size_t index) -> Layer&;
-    [[nodiscard]]
-    auto GetDisplayedCanvas() const -> CanvasData;
+    // All the layers flattened into one canvas. It's cached, only the regions
+    // changed since the last call get composited again.
+    auto GetDisplayedCanvas() -> const CanvasData&;
     void PushToHistory();
     void Undo();
     void Redo();
     void SetCurrentNode(Tree<Capture>& node_to_set_to);
     void UpdateAndDraw(bool should_do_tool, Tool& tool, Camera& camera);
     void InitHistory(Camera& camera, Tool& tool);
+    // The tiles changed since the last call, each one once
+    auto TakeChangedTiles() -> std::vector<ChangedTile>;
 
     [[nodiscard]] auto GetLayerCount() const -> std::size_t
     {
@@ -69,8 +129,7 @@ class Layers
     }
     [[nodiscard]] auto GetLayers() const -> const std::list<Layer>&
     {
-        assert(mCurrentCapture.has_value());
-        return mCurrentCapture->layers;
+        return mLayers;
     }
     [[nodiscard]] auto CanvasCoordsFromCursorPos() const
         -> std::optional<Vec2Int>
@@ -83,12 +142,12 @@ class Layers
     }
     [[nodiscard]] auto GetUndoTree() const -> const Tree<Capture>&
     {
-        assert(mUndoTree.has_value());
+        assert(mUndoTree != nullptr);
         return *mUndoTree;
     }
     [[nodiscard]] auto GetUndoTree() -> Tree<Capture>&
     {
-        assert(mUndoTree.has_value());
+        assert(mUndoTree != nullptr);
         return *mUndoTree;
     }
     [[nodiscard]] auto GetCurrentUndoTreeNode() const -> const Tree<Capture>&
@@ -96,37 +155,144 @@ class Layers
         assert(mCurrentUndoTreeNode != nullptr);
         return *mCurrentUndoTreeNode;
     }
+    // Memory used by the undo tree, in bytes
+    [[nodiscard]] auto GetHistoryByteSize() const -> std::size_t
+    {
+        return mHistoryByteSize;
+    }
+    [[nodiscard]] auto GetHistoryBudget() const -> std::size_t
+    {
+        return mHistoryBudget;
+    }
+    // Evicts history right away if it's over the new budget
+    void SetHistoryBudget(std::size_t budget_in_bytes);
+    // Instead of being evicted, history over the budget goes to a journal
+    // file at 'path', and only the tree itself stays in memory
+    auto EnableHistoryJournal(const std::string& path) -> bool;
+    // Loads the history from the journal back into memory. Fails, keeping
+    // the journal, if any of it can't be read back.
+    auto DisableHistoryJournal() -> bool;
+    [[nodiscard]] auto IsHistoryJournalEnabled() const -> bool
+    {
+        return mHistoryJournal.IsOpen();
+    }
+    [[nodiscard]] auto GetHistoryJournalSize() const -> std::size_t
+    {
+        return mHistoryJournal.GetSize();
+    }
     void SetCanvasDims(Vec2Int canvas_dims) { mCanvasDims = canvas_dims; }
     void MarkForUndo() { mShouldUndo = true; }
     void MarkForRedo() { mShouldRedo = true; }
     void MarkToAddLayer() { mShouldAddLayer = true; }
 
   private:
-    auto GetCapture() -> Capture&
-    {
-        assert(mCurrentCapture.has_value());
-        return *mCurrentCapture;
-    }
-    auto GetLayers() -> std::list<Layer>& { return GetCapture().layers; }
+    auto GetLayers() -> std::list<Layer>& { return mLayers; }
     void MarkHistoryForUpdate() { mShouldUpdateHistory = true; }
+    // Call before changing the order or the number of the layers
+    void BeginStructureChange();
+    // Commits the changes made since the last node to the undo tree, if
+    // there are any. Done before moving through the tree, so no change is
+    // lost.
+    void CommitPendingChanges();
+    void DiscardPendingChanges();
+    void ApplyBackward(const Capture& capture);
+    void ApplyForward(const Capture& capture);
+    // Reorders, removes and recreates layers to match 'structure'
+    void ApplyStructure(const std::vector<Layer>& structure);
+    // Swaps in the history's tile, which only marks that tile for the
+    // upload and the composite
+    void SetTile(Layer& layer, std::size_t tile_index,
+                 const TiledCanvas::TileHandle& handle);
+    auto FindLayer(std::size_t layer_id) -> Layer*;
+    [[nodiscard]] auto SnapshotLayers() const -> std::vector<Layer>;
+    // Call once the layers are as the node has them, so the next node's
+    // property changes are taken against those
+    void SetCurrentUndoTreeNode(Tree<Capture>& node);
+    // Of the layers whose properties changed since the current node
+    [[nodiscard]] auto GetPropertyChanges() const
+        -> std::vector<Capture::PropertyChange>;
+    void SnapshotProperties();
+    static auto GetProperties(const Layer& layer) -> Capture::LayerProperties;
+    static void SetProperties(Layer& layer,
+                              const Capture::LayerProperties& properties);
+    // Drops the least recently visited branches off the root and makes the
+    // oldest nodes the new root, until the history fits the budget. The
+    // path from the root to the current node is kept the longest.
+    void EnforceHistoryBudget();
+    // Moves the tiles of the least recently visited nodes to the journal,
+    // until the history fits the budget
+    void SpillToJournal();
+    [[nodiscard]] auto IsOnCurrentPath(const Tree<Capture>& node) const
+        -> bool;
+    // Compresses, in the background, the nodes which got far from the
+    // current one, and stores the results of the finished jobs
+    void CompressColdNodes();
+    void StoreFinishedCompressions();
+    // Call before applying the node, its tiles have to be there. Fails,
+    // leaving the node as it was, if they can't be read back.
+    [[nodiscard]] auto EnsureDecompressed(Tree<Capture>& node) -> bool;
+    // Drops the jobs of 'node' and its descendants
+    void CancelCompressions(const Tree<Capture>& node);
+    // Frees the handles once the tiles are stored somewhere else
+    static void ReleaseTiles(Capture& capture);
+    void RecountByteSize(Capture& capture);
+    static auto GetCaptureByteSize(const Capture& capture) -> std::size_t;
+    static auto GetSubtreeByteSize(const Tree<Capture>& node) -> std::size_t;
+    static auto GetSubtreeLastVisit(const Tree<Capture>& node) -> std::size_t;
+    // Every layer has to be uploaded and composited again
+    void InvalidateWholeCanvas();
+    // Decodes what's still lazily loaded from the project file, in the
+    // layers and in the history, which lets the file go
+    void LoadAllTiles();
+    void CompositeRect(Rect rect);
 
-    static constexpr int kMaxHistoryLenght = 30;
+    static constexpr std::size_t kDefaultHistoryBudget = 512UZ * 1024 * 1024;
+    // Nodes more undos or redos than this away from the current one get
+    // compressed
+    static constexpr std::size_t kColdNodeDistance = 16;
+
+    struct CompressionJob
+    {
+        Tree<Capture>* node;
+        std::shared_ptr<std::vector<std::byte>> result;
+        std::future<void> done;
+    };
 
     Tree<Capture>* mCurrentUndoTreeNode{nullptr};
-    std::optional<Tree<Capture>> mUndoTree{std::nullopt};
-    std::optional<Capture> mCurrentCapture{std::nullopt};
+    std::unique_ptr<Tree<Capture>> mUndoTree;
+    std::size_t mHistoryByteSize{0};
+    std::size_t mHistoryBudget{kDefaultHistoryBudget};
+    std::size_t mVisitCounter{0};
+    std::vector<CompressionJob> mCompressionJobs;
+    UndoJournal mHistoryJournal;
+    // The current node when cold nodes were last looked for
+    const Tree<Capture>* mLastCompressionScanNode{nullptr};
+    std::list<Layer> mLayers;
+    // Layers before the first structure change since the last node
+    std::optional<std::vector<Layer>> mPendingStructureBefore;
+    // Properties of the layers as of the current node, by layer id
+    std::vector<std::pair<std::size_t, Capture::LayerProperties>>
+        mNodeProperties;
     std::size_t mCurrentLayerIndex{0};
     Vec2Int mCanvasDims{0, 0};
+    CanvasData mFlattenedCanvas;
+    Rect mFlattenedDirtyRect;
+    std::vector<ChangedTile> mChangedTiles;
     bool mShouldUpdateHistory{false};
+    // Set from the press of the left button until its release. Commits are
+    // held back meanwhile, so a stroke or a held bucket is a single node.
+    bool mIsToolTransactionOpen{false};
     bool mShouldUndo{false};
     bool mShouldRedo{false};
     bool mShouldAddLayer{false};
 
     friend class Layer;
     friend class UI;
-    friend class VertexBufferControl;
+    friend class CanvasTextureControl;
     friend void Project::New(Vec2Int);
     friend void Project::Open(const std::string&);
+    friend auto Project::OpenAutosave(const std::string&) -> bool;
+    friend auto Project::ImportQoi(const std::string&) -> bool;
     friend void Project::SaveAsProject(const std::string&);
 };
 } // namespace Pikzel
@@ -15,16 +15,15 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "application.hpp"
+#include "canvas_texture_control.hpp"
 #include "events.hpp"
 #include "layer.hpp"
 #include "layer_control.hpp"
 #include "preview_layer.hpp"
 #include "project.hpp"
-#include "vertex_buffer_control.hpp"
 
 #include <cmath>
 #include <cstddef>
-#include <future>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -165,21 +164,28 @@ auto GetTransMat(Pikzel::Vec2Int canvas_coord_behind_cursor,
     return translation_mat;
 }
 
-// Binds the vbo
+// Writes the changed preview into the next region of the streaming vbo. The
+// vertex array is updated if the vbo had to grow.
 void UpdatePreviewVboIfNeeded(Pikzel::PreviewLayer& preview_layer,
                               std::vector<Vertex>& preview_vertices,
-                              Gla::VertexBuffer& vbo_preview)
+                              Gla::VertexBuffer& vbo_preview,
+                              const Gla::VertexArray& vao_preview,
+                              const Gla::VertexBufferLayout& layout)
 {
-    vbo_preview.Bind();
-    if (preview_layer.IsPreviewLayerChanged())
+    if (!preview_layer.IsPreviewLayerChanged()) { return; }
+
+    preview_vertices.clear();
+    preview_layer.EmplaceVertices(preview_vertices);
+    auto size = preview_vertices.size() * sizeof(Vertex);
+
+    if (vbo_preview.UpdateSizeIfNeeded(size))
     {
-        preview_vertices.clear();
-        preview_layer.EmplaceVertices(preview_vertices);
-        vbo_preview.UpdateSizeIfNeeded(preview_vertices.size() *
-                                       sizeof(Vertex));
-        vbo_preview.UpdateData(preview_vertices.data(),
-                               preview_vertices.size() * sizeof(Vertex));
+        vao_preview.AddBuffer(vbo_preview, layout);
     }
+
+    std::copy_n(preview_vertices.data(), preview_vertices.size(),
+                static_cast<Vertex*>(vbo_preview.BeginStreamWrite()));
+    vbo_preview.EndStreamWrite(size);
 }
 
 auto ImVec2Equal(ImVec2 vec_a, ImVec2 vec_b) -> bool
@@ -252,25 +258,15 @@ void MainLoop(GLFWwindow* window)
     Gla::VertexBufferLayout layout;
     layout.Push<float>(2);
     layout.Push<uint8_t>(4, GL_TRUE);
-    Gla::Shader shader("shader/vert_shader.vert", "shader/frag_shader.frag");
-    shader.Bind();
-
-    Gla::VertexArray vao_canvas;
-    Gla::VertexBuffer vbo_canvas(nullptr, 0, Gla::kDynamicDraw);
-    vao_canvas.AddBuffer(vbo_canvas, layout);
-    Gla::Group group_canvas(vao_canvas, shader);
+    Gla::Shader shader("shader/canvas_vert_shader.vert",
+                       "shader/canvas_frag_shader.frag");
 
-    Gla::VertexArray vao_bckg;
-    Gla::VertexBuffer vbo_bckg(nullptr, 0, Gla::kStaticDraw);
-    vao_bckg.AddBuffer(vbo_bckg, layout);
     Gla::Shader shader_bckg("shader/background_vert_shader.vert",
                             "shader/background_frag_shader.frag");
-    shader_bckg.Bind();
-    Gla::Group group_bckg(vao_bckg, shader_bckg);
-    auto bckg_vertices_count = 0UZ;
 
     Gla::VertexArray vao_preview;
-    Gla::VertexBuffer vbo_preview(nullptr, 0, Gla::kDynamicDraw);
+    constexpr auto kPreviewRegionSize = sizeof(Vertex) * 4096;
+    Gla::VertexBuffer vbo_preview(Gla::kPersistentStream, kPreviewRegionSize);
     vao_preview.AddBuffer(vbo_preview, layout);
     Gla::Shader shader_preview("shader/vert_shader.vert",
                                "shader/frag_shader.frag");
@@ -278,10 +274,8 @@ void MainLoop(GLFWwindow* window)
     std::vector<Vertex> preview_vertices;
 
     std::optional<Pikzel::PreviewLayer> preview_layer;
-    std::optional<Pikzel::VertexBufferControl> vbo_control;
-    std::future<void> vbo_update_future;
+    std::optional<Pikzel::CanvasTextureControl> canvas_textures;
     ImVec2 draw_window_dims;
-    float prev_fps = 0.0F;
     Gla::Timer out_of_loop_timer;
 
     while (glfwWindowShouldClose(window) == 0)
@@ -303,25 +297,7 @@ void MainLoop(GLFWwindow* window)
 
             if (project.IsOpened())
             {
-                std::vector<Vertex> bckg_vertices;
-                layers.EmplaceBckgVertices(bckg_vertices,
-                                           project.GetCanvasDims());
-                bckg_vertices_count = bckg_vertices.size();
-                auto bckg_buff_size = bckg_vertices.size() * sizeof(Vertex);
-                vbo_bckg.UpdateSize(bckg_buff_size);
-                vbo_bckg.UpdateData(bckg_vertices.data(), bckg_buff_size);
-
-                std::size_t vertex_count =
-                    static_cast<std::size_t>(project.CanvasWidth() *
-                                             project.CanvasHeight()) *
-                    Pikzel::kVerticesPerPixel;
-
-                vbo_canvas.UpdateSize(vertex_count * sizeof(Vertex));
-
-                auto* buff_data = static_cast<Vertex*>(
-                    glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
-
-                vbo_control.emplace(layers, buff_data, vertex_count);
+                canvas_textures.emplace(layers);
                 preview_layer.emplace(tool, camera, layers.GetCanvasDims());
             }
         }
@@ -331,12 +307,17 @@ void MainLoop(GLFWwindow* window)
         if (project.IsOpened() && ui_state.IsDrawWindowRendered())
         {
             assert(preview_layer.has_value());
-            assert(vbo_control.has_value());
+            assert(canvas_textures.has_value());
 
             auto proj_mat = GetProjMat(camera, project.GetCanvasDims());
             shader.Bind();
             shader.SetUniformMat4f("u_ViewProjection", proj_mat);
 
+            layers.UpdateAndDraw(ui_state.ShouldDoTool(), tool, camera);
+            project.UpdateAutosave();
+            canvas_textures->Update(Pikzel::Layer::ShouldUpdateWholeCanvas());
+            Pikzel::Layer::ResetUpdateWholeCanvas();
+
             imgui_window_fb.Bind();
 
             if (!ImVec2Equal(draw_window_dims, ui_state.GetDrawWinDimensions()))
@@ -350,36 +331,14 @@ void MainLoop(GLFWwindow* window)
             Gla::Renderer::Clear();
             glClearColor(0.8, 0.8, 0.8, 1.0);
 
-            group_bckg.Bind();
-            shader_bckg.SetUniformMat4f(
-                "u_ViewProjection",
-                GetProjMat(camera, project.GetCanvasDims()));
-            Gla::Renderer::DrawArrays(Gla::kTriangles, bckg_vertices_count);
-
-            if (vbo_update_future.valid()) { vbo_update_future.wait(); }
-
-            group_canvas.Bind();
-            vbo_control.value().UpdateSizeIfNeeded(vbo_canvas);
+            shader_bckg.Bind();
+            shader_bckg.SetUniformMat4f("u_ViewProjection", proj_mat);
+            canvas_textures->DrawBackground(shader_bckg);
 
-            Pikzel::VertexBufferControl::Unmap(vbo_canvas);
-            Gla::Renderer::DrawArrays(Gla::kTriangles,
-                                      vbo_control->GetVertexCount());
-            vbo_control->Map(vbo_canvas);
-
-            layers.UpdateAndDraw(ui_state.ShouldDoTool(), tool, camera);
-            vbo_update_future = std::async(
-                std::launch::async,
-                [&vbo_control, &prev_fps]()
-                {
-                    Gla::Timer timer;
-                    vbo_control->Update(Pikzel::Layer::ShouldUpdateWholeVBO(),
-                                        Pikzel::Layer::GetDirtyPixels());
-                    Pikzel::Layer::ResetDirtyPixelData();
-                    prev_fps = 1 / timer.GetTime();
-                });
+            canvas_textures->Draw(shader);
 
             UpdatePreviewVboIfNeeded(preview_layer.value(), preview_vertices,
-                                     vbo_preview);
+                                     vbo_preview, vao_preview, layout);
             auto canvas_coord_behind_cursor =
                 layers.CanvasCoordsFromCursorPos();
             if (canvas_coord_behind_cursor.has_value() &&
@@ -396,8 +355,10 @@ void MainLoop(GLFWwindow* window)
                 }
 
                 shader_preview.SetUniformMat4f("u_ViewProjection", result);
-                Gla::Renderer::DrawArrays(Gla::kTriangles,
-                                          preview_vertices.size());
+                Gla::Renderer::DrawArrays(
+                    Gla::kTriangles, preview_vertices.size(),
+                    vbo_preview.GetStreamRegionOffset() / sizeof(Vertex));
+                vbo_preview.FenceStreamRegion();
             }
 
             Gla::FrameBuffer::BindToDefaultFB();
@@ -416,9 +377,7 @@ void MainLoop(GLFWwindow* window)
         float fps = 1.0F / timer.GetTime();
         if (out_of_loop_timer.GetTime() > 0.2)
         {
-            std::string win_title =
-                "Pikzel - FPS: " + std::to_string(fps) +
-                " /// PREV_FPS: " + std::to_string(prev_fps);
+            std::string win_title = "Pikzel - FPS: " + std::to_string(fps);
             glfwSetWindowTitle(window, win_title.c_str());
             out_of_loop_timer.Reset();
         }
@@ -0,0 +1,141 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <iostream>
+
+namespace Pikzel
+{
+MappedFile::~MappedFile()
+{
+    Unmap();
+}
+
+#ifdef _WIN32
+auto MappedFile::Map(const std::string& path) -> bool
+{
+    Unmap();
+
+    // Others may keep writing to the file, like the undo journal does
+    mFileHandle = CreateFileA(path.c_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    LARGE_INTEGER size{};
+
+    if (mFileHandle == INVALID_HANDLE_VALUE ||
+        GetFileSizeEx(mFileHandle, &size) == 0)
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't open " << path << " in MappedFile::Map\n";
+#endif
+        mFileHandle = nullptr;
+        return false;
+    }
+
+    mIsMapped = true;
+
+    // Empty files can't be mapped
+    if (size.QuadPart == 0) { return true; }
+
+    mMappingHandle = CreateFileMappingA(mFileHandle, nullptr, PAGE_READONLY,
+                                        0, 0, nullptr);
+    const void* data =
+        mMappingHandle != nullptr
+            ? MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0)
+            : nullptr;
+
+    if (data == nullptr)
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't map " << path << " in MappedFile::Map\n";
+#endif
+        Unmap();
+        return false;
+    }
+
+    mData = static_cast<const std::byte*>(data);
+    mSize = static_cast<std::size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::Unmap()
+{
+    if (mData != nullptr) { UnmapViewOfFile(mData); }
+    if (mMappingHandle != nullptr) { CloseHandle(mMappingHandle); }
+    if (mFileHandle != nullptr) { CloseHandle(mFileHandle); }
+
+    mFileHandle = nullptr;
+    mMappingHandle = nullptr;
+    mData = nullptr;
+    mSize = 0;
+    mIsMapped = false;
+}
+#else
+auto MappedFile::Map(const std::string& path) -> bool
+{
+    Unmap();
+
+    const int file = open(path.c_str(), O_RDONLY);
+    struct stat file_stat{};
+
+    if (file == -1 || fstat(file, &file_stat) == -1)
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't open " << path << " in MappedFile::Map\n";
+#endif
+        if (file != -1) { close(file); }
+        return false;
+    }
+
+    mIsMapped = true;
+    const auto size = static_cast<std::size_t>(file_stat.st_size);
+
+    // Empty files can't be mapped
+    if (size == 0)
+    {
+        close(file);
+        return true;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+
+    if (data == MAP_FAILED)
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't map " << path << " in MappedFile::Map\n";
+#endif
+        mIsMapped = false;
+        return false;
+    }
+
+    mData = static_cast<const std::byte*>(data);
+    mSize = size;
+    return true;
+}
+
+void MappedFile::Unmap()
+{
+    if (mData != nullptr)
+    {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+        munmap(const_cast<std::byte*>(mData), mSize);
+    }
+
+    mData = nullptr;
+    mSize = 0;
+    mIsMapped = false;
+}
+#endif
+} // namespace Pikzel
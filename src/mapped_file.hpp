@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+namespace Pikzel
+{
+// Read only view of a whole file, mapped into memory. The OS pages the
+// contents in when they're touched and can drop them again under pressure.
+class MappedFile
+{
+  public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    auto operator=(const MappedFile&) -> MappedFile& = delete;
+    auto operator=(MappedFile&&) -> MappedFile& = delete;
+    ~MappedFile();
+
+    // Unmaps the previous file, if any
+    auto Map(const std::string& path) -> bool;
+    void Unmap();
+
+    [[nodiscard]] auto GetData() const -> std::span<const std::byte>
+    {
+        return {mData, mSize};
+    }
+    [[nodiscard]] auto IsMapped() const -> bool { return mIsMapped; }
+
+  private:
+#ifdef _WIN32
+    void* mFileHandle = nullptr;
+    void* mMappingHandle = nullptr;
+#endif
+    const std::byte* mData = nullptr;
+    std::size_t mSize = 0;
+    bool mIsMapped = false;
+};
+} // namespace Pikzel
@@ -0,0 +1,95 @@
+#include "palette.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+namespace Pikzel
+{
+namespace
+{
+auto Pack(Color color) -> uint32_t
+{
+    return std::bit_cast<uint32_t>(color);
+}
+} // namespace
+
+auto Palette::Find(std::span<const Color> pixels) -> std::optional<Palette>
+{
+    static_assert(sizeof(Color) == sizeof(uint32_t));
+
+    Palette palette;
+    std::optional<Color> previous;
+
+    for (const auto pixel : pixels)
+    {
+        // Pixel art is mostly runs of one color, those take no lookup
+        if (previous.has_value() && Pack(*previous) == Pack(pixel))
+        {
+            continue;
+        }
+
+        previous = pixel;
+        const auto slot = palette.FindSlot(pixel);
+
+        if (palette.mSlots[slot] != kEmptySlot) { continue; }
+
+        if (palette.mColors.size() == kMaxSize) { return std::nullopt; }
+
+        palette.mSlots[slot] = static_cast<int16_t>(palette.mColors.size());
+        palette.mColors.push_back(pixel);
+    }
+
+    std::ranges::stable_partition(palette.mColors, [](Color color)
+                                  { return color.a != 0xFF; });
+    palette.RebuildSlots();
+    return palette;
+}
+
+void Palette::ToIndices(std::span<const Color> pixels,
+                        std::span<uint8_t> dst) const
+{
+    assert(dst.size() == pixels.size());
+
+    uint8_t index = 0;
+
+    for (std::size_t i = 0; i < pixels.size(); i++)
+    {
+        if (i == 0 || Pack(pixels[i]) != Pack(pixels[i - 1]))
+        {
+            const auto slot = mSlots[FindSlot(pixels[i])];
+            assert(slot != kEmptySlot);
+            index = static_cast<uint8_t>(slot);
+        }
+
+        dst[i] = index;
+    }
+}
+
+auto Palette::FindSlot(Color color) const -> std::size_t
+{
+    constexpr uint32_t kMultiplier = 2654435761U;
+    constexpr std::size_t kMask = (1UZ << kSlotBits) - 1;
+    const auto packed = Pack(color);
+    std::size_t slot = (packed * kMultiplier) >> (32U - kSlotBits);
+
+    // Linear probing, there's always an empty slot
+    while (mSlots[slot] != kEmptySlot &&
+           Pack(mColors[static_cast<std::size_t>(mSlots[slot])]) != packed)
+    {
+        slot = (slot + 1) & kMask;
+    }
+
+    return slot;
+}
+
+void Palette::RebuildSlots()
+{
+    mSlots.fill(kEmptySlot);
+
+    for (std::size_t i = 0; i < mColors.size(); i++)
+    {
+        mSlots[FindSlot(mColors[i])] = static_cast<int16_t>(i);
+    }
+}
+} // namespace Pikzel
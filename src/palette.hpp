@@ -0,0 +1,50 @@
+#pragma once
+
+#include "color.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace Pikzel
+{
+// The distinct colors of an image, when there are few enough of them for
+// an indexed PNG. The colors which aren't fully opaque come first, so the
+// PNG's transparency table can stop after them.
+class Palette
+{
+  public:
+    static constexpr std::size_t kMaxSize = 256;
+
+    // Empty if 'pixels' has more than kMaxSize colors
+    [[nodiscard]] static auto Find(std::span<const Color> pixels)
+        -> std::optional<Palette>;
+
+    [[nodiscard]] auto GetColors() const -> std::span<const Color>
+    {
+        return mColors;
+    }
+    // Replaces every one of 'pixels', which all have to be in the palette,
+    // with its index
+    void ToIndices(std::span<const Color> pixels,
+                   std::span<uint8_t> dst) const;
+
+  private:
+    Palette() { mSlots.fill(kEmptySlot); }
+
+    // Returns the slot of 'color', or the empty one it would go to
+    [[nodiscard]] auto FindSlot(Color color) const -> std::size_t;
+    void RebuildSlots();
+
+    // A power of 2, a quarter full at most so the probes stay short
+    static constexpr uint32_t kSlotBits = 10;
+    static constexpr int16_t kEmptySlot = -1;
+
+    std::vector<Color> mColors;
+    // Open addressing, an index into mColors or kEmptySlot
+    std::array<int16_t, 1UZ << kSlotBits> mSlots{};
+};
+} // namespace Pikzel
@@ -0,0 +1,261 @@
+#include "pkz_format.hpp"
+#include "byte_io.hpp"
+#include "compression.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+namespace Pikzel::Pkz
+{
+namespace
+{
+constexpr std::size_t kHeaderSize = kMagic.size() + (5 * sizeof(uint32_t));
+constexpr std::size_t kLayerEntrySize = 2 * sizeof(uint32_t);
+constexpr std::size_t kChunkEntrySize =
+    sizeof(uint64_t) + (2 * sizeof(uint32_t));
+// Canvas coords are ints, and the tile count is rounded up
+constexpr auto kMaxDimension = static_cast<uint32_t>(
+    std::numeric_limits<int>::max() - TiledCanvas::kTileSize);
+
+using ByteIo::Append;
+using ByteIo::Reader;
+
+auto TileBytes(const TiledCanvas::Tile& tile) -> std::span<const std::byte>
+{
+    return std::as_bytes(std::span{tile});
+}
+} // namespace
+
+auto WriteProject(std::ostream& out, Vec2Int canvas_dims,
+                  const std::vector<LayerSnapshot>& layers,
+                  std::atomic<float>* progress /*= nullptr*/) -> bool
+{
+    // Writing is quick next to the encoding
+    constexpr float kEncodingShare = 0.9F;
+
+    struct Chunk
+    {
+        const TiledCanvas::Tile* tile;
+        ChunkEntry* entry;
+        std::vector<std::byte> data;
+    };
+
+    Tables tables{.width = static_cast<uint32_t>(canvas_dims.x),
+                  .height = static_cast<uint32_t>(canvas_dims.y),
+                  .layers = {}};
+    tables.layers.reserve(layers.size());
+    std::vector<Chunk> chunks;
+
+    for (const auto& layer : layers)
+    {
+        auto& layer_entry = tables.layers.emplace_back(
+            layer.opacity, std::vector<ChunkEntry>(layer.tiles.size()));
+
+        for (std::size_t i = 0; i < layer.tiles.size(); i++)
+        {
+            assert(layer.tiles[i] != nullptr);
+
+            if (layer.tiles[i] == TiledCanvas::GetEmptyTile()) { continue; }
+
+            chunks.push_back({.tile = layer.tiles[i].get(),
+                              .entry = &layer_entry.chunks[i],
+                              .data = {}});
+        }
+    }
+
+    std::atomic<std::size_t> encoded_count{0};
+
+    ThreadPool::Get().ParallelFor(
+        chunks.size(),
+        [&](std::size_t index)
+        {
+            auto& chunk = chunks[index];
+            chunk.entry->codec = EncodeChunk(*chunk.tile, chunk.data);
+            chunk.entry->size = static_cast<uint32_t>(chunk.data.size());
+
+            const auto encoded = encoded_count.fetch_add(1) + 1;
+            if (progress != nullptr)
+            {
+                progress->store(kEncodingShare * static_cast<float>(encoded) /
+                                static_cast<float>(chunks.size()));
+            }
+        });
+
+    uint64_t offset = GetTablesSize(tables);
+
+    for (auto& chunk : chunks)
+    {
+        chunk.entry->offset = offset;
+        offset += chunk.data.size();
+    }
+
+    std::vector<std::byte> table_data;
+    AppendTables(tables, table_data);
+    out.write(reinterpret_cast<const char*>(table_data.data()),
+              static_cast<std::streamsize>(table_data.size()));
+
+    for (const auto& chunk : chunks)
+    {
+        out.write(reinterpret_cast<const char*>(chunk.data.data()),
+                  static_cast<std::streamsize>(chunk.data.size()));
+    }
+
+    if (progress != nullptr) { progress->store(1.0F); }
+
+    return static_cast<bool>(out);
+}
+
+auto IsBinaryProject(std::span<const std::byte> file) -> bool
+{
+    return file.size() >= kMagic.size() &&
+           std::ranges::equal(file.first(kMagic.size()), kMagic);
+}
+
+auto GetTablesSize(const Tables& tables) -> std::size_t
+{
+    std::size_t size = kHeaderSize;
+
+    for (const auto& layer : tables.layers)
+    {
+        size += kLayerEntrySize + (layer.chunks.size() * kChunkEntrySize);
+    }
+
+    return size;
+}
+
+void AppendTables(const Tables& tables, std::vector<std::byte>& dst)
+{
+    dst.insert(dst.end(), kMagic.begin(), kMagic.end());
+    Append(kVersion, dst);
+    Append(tables.width, dst);
+    Append(tables.height, dst);
+    Append(static_cast<uint32_t>(tables.layers.size()), dst);
+    Append(static_cast<uint32_t>(TiledCanvas::kTileSize), dst);
+
+    for (const auto& layer : tables.layers)
+    {
+        Append(layer.opacity, dst);
+        Append(static_cast<uint32_t>(layer.chunks.size()), dst);
+
+        for (const auto& chunk : layer.chunks)
+        {
+            Append(chunk.offset, dst);
+            Append(chunk.size, dst);
+            Append(static_cast<uint32_t>(chunk.codec), dst);
+        }
+    }
+}
+
+auto ParseTables(std::span<const std::byte> file) -> std::optional<Tables>
+{
+    if (!IsBinaryProject(file)) { return std::nullopt; }
+
+    Reader reader{file.subspan(kMagic.size())};
+    Tables tables;
+
+    const auto version = reader.Read<uint32_t>();
+    tables.width = reader.Read<uint32_t>();
+    tables.height = reader.Read<uint32_t>();
+    const auto layer_count = reader.Read<uint32_t>();
+    const auto tile_size = reader.Read<uint32_t>();
+
+    if (reader.HasFailed() || version != kVersion ||
+        tile_size != TiledCanvas::kTileSize || tables.width == 0 ||
+        tables.height == 0 || tables.width > kMaxDimension ||
+        tables.height > kMaxDimension || layer_count == 0)
+    {
+        return std::nullopt;
+    }
+
+    const std::size_t tiles_per_row =
+        (tables.width + TiledCanvas::kTileSize - 1) / TiledCanvas::kTileSize;
+    const std::size_t tiles_per_col =
+        (tables.height + TiledCanvas::kTileSize - 1) / TiledCanvas::kTileSize;
+    const std::size_t chunk_count = tiles_per_row * tiles_per_col;
+
+    // Every layer entry is at least this big, which bounds the allocations
+    // below for a corrupted file
+    if (layer_count > file.size() / (kLayerEntrySize +
+                                     (chunk_count * kChunkEntrySize)))
+    {
+        return std::nullopt;
+    }
+
+    tables.layers.resize(layer_count);
+
+    for (auto& layer : tables.layers)
+    {
+        layer.opacity = reader.Read<uint32_t>();
+
+        if (reader.Read<uint32_t>() != chunk_count) { return std::nullopt; }
+
+        layer.chunks.resize(chunk_count);
+
+        for (auto& chunk : layer.chunks)
+        {
+            chunk.offset = reader.Read<uint64_t>();
+            chunk.size = reader.Read<uint32_t>();
+            chunk.codec = static_cast<ChunkCodec>(reader.Read<uint32_t>());
+
+            const bool is_known_codec =
+                chunk.codec == ChunkCodec::kEmpty ||
+                chunk.codec == ChunkCodec::kRaw ||
+                chunk.codec == ChunkCodec::kCompressed;
+
+            if (reader.HasFailed() || !is_known_codec ||
+                chunk.offset > file.size() ||
+                chunk.size > file.size() - chunk.offset)
+            {
+                return std::nullopt;
+            }
+        }
+    }
+
+    return tables;
+}
+
+auto EncodeChunk(const TiledCanvas::Tile& tile, std::vector<std::byte>& dst)
+    -> ChunkCodec
+{
+    const auto pixels = TileBytes(tile);
+
+    if (std::ranges::all_of(pixels, [](std::byte byte)
+                            { return byte == std::byte{0}; }))
+    {
+        return ChunkCodec::kEmpty;
+    }
+
+    const std::size_t begin = dst.size();
+    Compression::Compress(pixels, dst);
+
+    if (dst.size() - begin < pixels.size()) { return ChunkCodec::kCompressed; }
+
+    dst.resize(begin);
+    dst.insert(dst.end(), pixels.begin(), pixels.end());
+    return ChunkCodec::kRaw;
+}
+
+auto DecodeChunk(std::span<const std::byte> chunk, ChunkCodec codec,
+                 TiledCanvas::Tile& tile) -> bool
+{
+    const auto pixels = std::as_writable_bytes(std::span{tile});
+
+    switch (codec)
+    {
+    case ChunkCodec::kEmpty:
+        std::ranges::fill(pixels, std::byte{0});
+        return chunk.empty();
+    case ChunkCodec::kRaw:
+        if (chunk.size() != pixels.size()) { return false; }
+        std::memcpy(pixels.data(), chunk.data(), pixels.size());
+        return true;
+    case ChunkCodec::kCompressed:
+        return Compression::Decompress(chunk, pixels);
+    }
+
+    return false;
+}
+} // namespace Pikzel::Pkz
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "tiled_canvas.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <vector>
+
+// Binary project format, version 2. Version 1 was plain text and starts
+// with the layer count, so a file starting with kMagic is always binary.
+//
+// All the numbers are little endian:
+//     header        magic, version, width, height, layer count, tile size
+//     layer table   per layer: opacity, chunk count, then its chunk entries
+//     chunks        the tiles of every layer, as described by the entries
+// Every chunk is one tile of a layer, in the order of TiledCanvas, so a
+// layer can be loaded by decoding straight into its tiles.
+namespace Pikzel::Pkz
+{
+constexpr std::array<std::byte, 4> kMagic = {std::byte{'P'}, std::byte{'K'},
+                                             std::byte{'Z'}, std::byte{'B'}};
+constexpr uint32_t kVersion = 2;
+
+enum class ChunkCodec : uint32_t
+{
+    // Fully transparent, no data stored
+    kEmpty = 0,
+    kRaw = 1,
+    // See Compression::Compress
+    kCompressed = 2,
+};
+
+struct ChunkEntry
+{
+    // From the start of the file
+    uint64_t offset = 0;
+    uint32_t size = 0;
+    ChunkCodec codec = ChunkCodec::kEmpty;
+};
+
+struct LayerEntry
+{
+    uint32_t opacity = 0;
+    std::vector<ChunkEntry> chunks;
+};
+
+struct Tables
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<LayerEntry> layers;
+};
+
+// What gets saved of a layer. The handles keep the tiles as they were when
+// it was taken, drawing afterwards clones them.
+struct LayerSnapshot
+{
+    uint32_t opacity = 0;
+    std::vector<TiledCanvas::TileHandle> tiles;
+};
+
+// Encodes the chunks of all the layers in parallel, then writes them in
+// order, after the tables. The tiles have to be loaded. 'progress' goes
+// from 0 to 1 along the way, if given.
+[[nodiscard]] auto WriteProject(std::ostream& out, Vec2Int canvas_dims,
+                                const std::vector<LayerSnapshot>& layers,
+                                std::atomic<float>* progress = nullptr)
+    -> bool;
+
+[[nodiscard]] auto IsBinaryProject(std::span<const std::byte> file) -> bool;
+// Size of the header and the layer table, the chunks start right after
+[[nodiscard]] auto GetTablesSize(const Tables& tables) -> std::size_t;
+void AppendTables(const Tables& tables, std::vector<std::byte>& dst);
+// Checks the chunks lie inside of the file, so they can be read without
+// any further checks, and the dims fit the canvas. Returns std::nullopt for
+// an invalid file.
+[[nodiscard]] auto ParseTables(std::span<const std::byte> file)
+    -> std::optional<Tables>;
+
+// Appends the tile to 'dst', compressed unless that makes it bigger
+auto EncodeChunk(const TiledCanvas::Tile& tile, std::vector<std::byte>& dst)
+    -> ChunkCodec;
+[[nodiscard]] auto DecodeChunk(std::span<const std::byte> chunk,
+                               ChunkCodec codec, TiledCanvas::Tile& tile)
+    -> bool;
+} // namespace Pikzel::Pkz
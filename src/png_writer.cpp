@@ -0,0 +1,314 @@
+#include "png_writer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+
+namespace Pikzel
+{
+namespace
+{
+constexpr std::array<uint8_t, 8> kSignature = {0x89, 'P',  'N',  'G',
+                                               '\r', '\n', 0x1A, '\n'};
+constexpr std::size_t kMaxPaletteSize = 256;
+
+enum class Filter : uint8_t
+{
+    kNone = 0,
+    kSub = 1,
+    kUp = 2,
+    kPaeth = 4,
+};
+
+constexpr auto MakeCrcTable() -> std::array<uint32_t, 256>
+{
+    std::array<uint32_t, 256> table{};
+
+    for (uint32_t i = 0; i < table.size(); i++)
+    {
+        uint32_t crc = i;
+
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1U) != 0 ? 0xEDB88320U ^ (crc >> 1U) : crc >> 1U;
+        }
+
+        table[i] = crc;
+    }
+
+    return table;
+}
+
+constexpr auto kCrcTable = MakeCrcTable();
+
+auto UpdateCrc(uint32_t crc, std::span<const std::byte> data) -> uint32_t
+{
+    for (const auto byte : data)
+    {
+        crc = kCrcTable[(crc ^ static_cast<uint32_t>(byte)) & 0xFFU] ^
+              (crc >> 8U);
+    }
+
+    return crc;
+}
+
+auto GetPaethPredictor(uint8_t left, uint8_t up, uint8_t up_left) -> uint8_t
+{
+    const int estimate = left + up - up_left;
+    const int left_distance = std::abs(estimate - left);
+    const int up_distance = std::abs(estimate - up);
+    const int up_left_distance = std::abs(estimate - up_left);
+
+    if (left_distance <= up_distance && left_distance <= up_left_distance)
+    {
+        return left;
+    }
+
+    return up_distance <= up_left_distance ? up : up_left;
+}
+
+// Writes the filter byte and the filtered 'row' to 'dst'
+void FilterRow(Filter filter, std::span<const std::byte> row,
+               std::span<const std::byte> previous, std::size_t bytes_per_pixel,
+               std::span<std::byte> dst)
+{
+    dst[0] = static_cast<std::byte>(filter);
+
+    const auto apply = [&](auto predict)
+    {
+        for (std::size_t i = 0; i < row.size(); i++)
+        {
+            const auto get = [&](std::span<const std::byte> bytes,
+                                 std::size_t offset) -> uint8_t
+            {
+                return i >= offset ? static_cast<uint8_t>(bytes[i - offset])
+                                   : 0;
+            };
+            const auto predicted =
+                predict(get(row, bytes_per_pixel), get(previous, 0),
+                        get(previous, bytes_per_pixel));
+            dst[i + 1] = static_cast<std::byte>(get(row, 0) - predicted);
+        }
+    };
+
+    switch (filter)
+    {
+    case Filter::kNone:
+        std::ranges::copy(row, dst.begin() + 1);
+        break;
+    case Filter::kSub:
+        apply([](uint8_t left, uint8_t, uint8_t) { return left; });
+        break;
+    case Filter::kUp:
+        apply([](uint8_t, uint8_t up, uint8_t) { return up; });
+        break;
+    case Filter::kPaeth:
+        apply(GetPaethPredictor);
+        break;
+    }
+}
+
+// The sum of the filtered bytes taken as signed, the smaller the better the
+// filter predicted the row. The heuristic libpng uses.
+auto GetFilterCost(std::span<const std::byte> filtered) -> uint64_t
+{
+    uint64_t cost = 0;
+
+    for (const auto byte : filtered.subspan(1))
+    {
+        const auto value = static_cast<uint32_t>(byte);
+        cost += std::min(value, 256 - value);
+    }
+
+    return cost;
+}
+
+// PNG numbers are big endian
+void AppendBigEndian(uint32_t value, std::vector<std::byte>& dst)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        dst.push_back(static_cast<std::byte>(value >> shift));
+    }
+}
+} // namespace
+
+PngWriter::PngWriter(std::ostream& out, uint32_t width, uint32_t height,
+                     std::span<const Color> palette /*= {}*/)
+    : mOut{out}, mWidth{width}, mHeight{height},
+      mBytesPerPixel{palette.empty() ? sizeof(Color) : 1},
+      mFilteredRow(1 + (std::size_t{width} * mBytesPerPixel)),
+      mBestFilteredRow(mFilteredRow.size()),
+      mRepeatedRow(mFilteredRow.size(), std::byte{0})
+{
+    assert(width != 0 && width <= kMaxDimension);
+    assert(height != 0 && height <= kMaxDimension);
+    assert(palette.size() <= kMaxPaletteSize);
+
+    mRepeatedRow[0] = static_cast<std::byte>(Filter::kUp);
+    mOut.get().write(reinterpret_cast<const char*>(kSignature.data()),
+                     kSignature.size());
+
+    // RGBA or indexed
+    const uint8_t color_type = palette.empty() ? 6 : 3;
+    std::vector<std::byte> header;
+    AppendBigEndian(width, header);
+    AppendBigEndian(height, header);
+    // 8 bits per channel or index, deflate, adaptive filtering, no
+    // interlacing
+    for (const uint8_t value : {uint8_t{8}, color_type, uint8_t{0},
+                                uint8_t{0}, uint8_t{0}})
+    {
+        header.push_back(static_cast<std::byte>(value));
+    }
+    WriteChunk("IHDR", header);
+
+    if (palette.empty()) { return; }
+
+    std::vector<std::byte> colors;
+    std::vector<std::byte> alphas;
+
+    for (const auto color : palette)
+    {
+        for (const auto channel : {color.r, color.g, color.b})
+        {
+            colors.push_back(static_cast<std::byte>(channel));
+        }
+
+        alphas.push_back(static_cast<std::byte>(color.a));
+    }
+
+    // Entries missing from the end of tRNS are opaque
+    while (!alphas.empty() && alphas.back() == std::byte{0xFF})
+    {
+        alphas.pop_back();
+    }
+
+    WriteChunk("PLTE", colors);
+    if (!alphas.empty()) { WriteChunk("tRNS", alphas); }
+}
+
+auto PngWriter::WriteRow(std::span<const Color> row,
+                         std::size_t count /*= 1*/) -> bool
+{
+    assert(mBytesPerPixel == sizeof(Color));
+    return WriteRowBytes(std::as_bytes(row), count);
+}
+
+auto PngWriter::WriteRow(std::span<const uint8_t> row,
+                         std::size_t count /*= 1*/) -> bool
+{
+    assert(mBytesPerPixel == 1);
+    return WriteRowBytes(std::as_bytes(row), count);
+}
+
+auto PngWriter::WriteRowBytes(std::span<const std::byte> row,
+                              std::size_t count) -> bool
+{
+    assert(row.size() == mWidth * mBytesPerPixel);
+    assert(count != 0 && count <= mHeight - mRowsWritten);
+
+    // Rows repeated by magnifying become all zeros, which compress to
+    // almost nothing
+    if (mRowsWritten != 0 && std::ranges::equal(row, mPreviousRow))
+    {
+        mDeflater.Write(mRepeatedRow, mCompressed);
+    }
+    else
+    {
+        // Differences of indices mean nothing, the spec advises no filter
+        // for indexed images
+        constexpr std::array kRgbaFilters = {Filter::kNone, Filter::kSub,
+                                             Filter::kUp, Filter::kPaeth};
+        const auto filters = mBytesPerPixel == 1
+                                 ? std::span{kRgbaFilters}.first(1)
+                                 : std::span{kRgbaFilters};
+
+        // The first row is filtered against a row of zeros
+        mPreviousRow.resize(row.size(), std::byte{0});
+        std::optional<uint64_t> best_cost;
+
+        for (const auto filter : filters)
+        {
+            FilterRow(filter, row, mPreviousRow, mBytesPerPixel,
+                      mFilteredRow);
+            const auto cost = GetFilterCost(mFilteredRow);
+
+            if (!best_cost.has_value() || cost < *best_cost)
+            {
+                best_cost = cost;
+                std::swap(mFilteredRow, mBestFilteredRow);
+            }
+        }
+
+        mDeflater.Write(mBestFilteredRow, mCompressed);
+        mPreviousRow.assign(row.begin(), row.end());
+    }
+
+    for (std::size_t i = 1; i < count; i++)
+    {
+        mDeflater.Write(mRepeatedRow, mCompressed);
+        FlushCompressed(false);
+    }
+
+    mRowsWritten += static_cast<uint32_t>(count);
+    FlushCompressed(false);
+    return static_cast<bool>(mOut.get());
+}
+
+auto PngWriter::Finish() -> bool
+{
+    assert(mRowsWritten == mHeight);
+
+    mDeflater.Finish(mCompressed);
+    FlushCompressed(true);
+    WriteChunk("IEND", {});
+    return static_cast<bool>(mOut.get());
+}
+
+void PngWriter::WriteChunk(const char* type, std::span<const std::byte> data)
+{
+    std::vector<std::byte> header;
+    AppendBigEndian(static_cast<uint32_t>(data.size()), header);
+    const auto type_bytes = std::as_bytes(std::span{type, 4});
+    header.insert(header.end(), type_bytes.begin(), type_bytes.end());
+
+    // Covers the type and the data
+    auto crc = UpdateCrc(0xFFFFFFFFU, type_bytes);
+    crc = UpdateCrc(crc, data) ^ 0xFFFFFFFFU;
+
+    std::vector<std::byte> footer;
+    AppendBigEndian(crc, footer);
+
+    for (const auto part : {std::span<const std::byte>{header}, data,
+                            std::span<const std::byte>{footer}})
+    {
+        mOut.get().write(reinterpret_cast<const char*>(part.data()),
+                         static_cast<std::streamsize>(part.size()));
+    }
+}
+
+void PngWriter::FlushCompressed(bool should_flush_all)
+{
+    std::size_t written = 0;
+
+    while (mCompressed.size() - written >= kChunkSize)
+    {
+        WriteChunk("IDAT", std::span{mCompressed}.subspan(written, kChunkSize));
+        written += kChunkSize;
+    }
+
+    if (should_flush_all && written != mCompressed.size())
+    {
+        WriteChunk("IDAT", std::span{mCompressed}.subspan(written));
+        written = mCompressed.size();
+    }
+
+    mCompressed.erase(
+        mCompressed.begin(),
+        mCompressed.begin() + static_cast<std::ptrdiff_t>(written));
+}
+} // namespace Pikzel
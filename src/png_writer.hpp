@@ -0,0 +1,69 @@
+#pragma once
+
+#include "color.hpp"
+#include "deflate.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <span>
+#include <vector>
+
+namespace Pikzel
+{
+// Writes an RGBA or an 8-bit indexed PNG one row at a time, so only a row
+// of the image has to be in memory, however big the image is. Each RGBA
+// row gets the filter which predicts it best.
+class PngWriter
+{
+  public:
+    // Writes the header right away. With a 'palette', of at most 256
+    // colors, the rows are indices into it.
+    PngWriter(std::ostream& out, uint32_t width, uint32_t height,
+              std::span<const Color> palette = {});
+    PngWriter(const PngWriter&) = delete;
+    PngWriter(PngWriter&&) = delete;
+    auto operator=(const PngWriter&) -> PngWriter& = delete;
+    auto operator=(PngWriter&&) -> PngWriter& = delete;
+    ~PngWriter() = default;
+
+    // PNG allows no more in either direction
+    static constexpr uint32_t kMaxDimension = 0x7FFFFFFF;
+
+    // From the top, 'row' has to be 'width' pixels. Writing it 'count'
+    // times costs little more than once.
+    auto WriteRow(std::span<const Color> row, std::size_t count = 1) -> bool;
+    // Same, for an indexed PNG
+    auto WriteRow(std::span<const uint8_t> row, std::size_t count = 1)
+        -> bool;
+    // Call once all the rows are written. Fails if any write failed.
+    auto Finish() -> bool;
+
+  private:
+    auto WriteRowBytes(std::span<const std::byte> row, std::size_t count)
+        -> bool;
+    void WriteChunk(const char* type, std::span<const std::byte> data);
+    // Writes the compressed data once there's enough of it for a chunk
+    void FlushCompressed(bool should_flush_all);
+
+    // IDAT chunks of about this size
+    static constexpr std::size_t kChunkSize = 64UZ * 1024;
+
+    std::reference_wrapper<std::ostream> mOut;
+    uint32_t mWidth;
+    uint32_t mHeight;
+    uint32_t mRowsWritten = 0;
+    // 4 for RGBA, 1 for an index
+    std::size_t mBytesPerPixel;
+    Deflater mDeflater;
+    std::vector<std::byte> mCompressed;
+    std::vector<std::byte> mPreviousRow;
+    // The filter byte and the filtered row, for each filter tried and for
+    // the best one so far
+    std::vector<std::byte> mFilteredRow;
+    std::vector<std::byte> mBestFilteredRow;
+    // Filter byte and the filtered row, of a row same as the one before
+    std::vector<std::byte> mRepeatedRow;
+};
+} // namespace Pikzel
@@ -1,25 +1,249 @@
 #include "project.hpp"
+#include "atomic_file.hpp"
+#include "autosave_journal.hpp"
 #include "camera.hpp"
 #include "layer.hpp"
 #include "layer_control.hpp"
+#include "mapped_file.hpp"
+#include "palette.hpp"
+#include "pkz_format.hpp"
+#include "png_writer.hpp"
+#include "qoi.hpp"
+#include "thread_pool.hpp"
 #include "tool.hpp"
+#include "upscale.hpp"
 
 #include <stb/stb_image.h>
 #include <stb/stb_image_resize2.h>
 #include <stb/stb_image_write.h>
 
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
 
 namespace Pikzel
 {
+namespace
+{
+constexpr std::string_view kAutosaveExtension = ".autosave";
+// For projects not saved to a file yet
+constexpr std::string_view kUnsavedAutosaveName = "pikzel_unsaved.autosave";
+
+// Next to the project file, or in the temp dir if there's none
+auto GetSidecarPath(const std::string& file_path, std::string_view extension,
+                    std::string_view temp_name) -> std::string
+{
+    if (file_path.empty())
+    {
+        std::error_code error;
+        auto temp_dir = std::filesystem::temp_directory_path(error);
+        return (temp_dir / temp_name).string();
+    }
+
+    return file_path + std::string{extension};
+}
+
+auto IsNewer(const std::string& path, const std::string& than_path) -> bool
+{
+    std::error_code error;
+    const auto time = std::filesystem::last_write_time(path, error);
+
+    if (error) { return false; }
+
+    const auto than_time = std::filesystem::last_write_time(than_path, error);
+    return !error && time > than_time;
+}
+
+// Decodes the chunks of one layer, each one the first time its tile is used.
+// The loaders of all the layers keep the file mapped.
+auto MakeTileLoader(std::shared_ptr<const MappedFile> mapping,
+                    std::vector<Pkz::ChunkEntry> chunks)
+    -> TiledCanvas::TileLoader
+{
+    return [mapping = std::move(mapping), chunks = std::move(chunks)](
+               std::size_t tile_index) -> TiledCanvas::TileHandle
+    {
+        const auto& chunk = chunks[tile_index];
+        auto tile = std::make_shared<TiledCanvas::Tile>();
+
+        // The chunk is inside of the file, ParseTables checked that
+        if (!Pkz::DecodeChunk(
+                mapping->GetData().subspan(chunk.offset, chunk.size),
+                chunk.codec, *tile))
+        {
+#ifndef NDEBUG
+            std::cerr << "Corrupted tile " << tile_index
+                      << " in a project file, it's left transparent\n";
+#endif
+            return nullptr;
+        }
+
+        return tile;
+    };
+}
+
+// The image is streamed, it could be many gigabytes. A batch of source
+// rows is widened at once, in parallel, and every widened row is written
+// 'factor' times.
+auto WriteStreamedPng(const std::string& path, std::span<const Color> canvas,
+                      std::size_t canvas_width, std::size_t factor) -> bool
+{
+    constexpr std::size_t kMaxBatchPixels = 4UZ * 1024 * 1024;
+    const auto width = canvas_width * factor;
+    const auto canvas_height = canvas.size() / canvas_width;
+    const auto batch_row_count = std::max(1UZ, kMaxBatchPixels / width);
+    std::vector<Color> batch(std::min(batch_row_count, canvas_height) * width);
+
+    return WriteFileAtomically(
+        path,
+        [&](std::ostream& out)
+        {
+            PngWriter writer{out, static_cast<uint32_t>(width),
+                             static_cast<uint32_t>(canvas_height * factor)};
+            const auto batch_size = batch_row_count * canvas_width;
+
+            for (std::size_t i = 0; i < canvas.size(); i += batch_size)
+            {
+                const auto source = canvas.subspan(
+                    i, std::min(batch_size, canvas.size() - i));
+                const auto widened =
+                    std::span{batch}.first(source.size() * factor);
+                Upscale::WidenRows(widened, source, canvas_width, factor);
+
+                for (std::size_t row = 0; row < widened.size(); row += width)
+                {
+                    if (!writer.WriteRow(widened.subspan(row, width), factor))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            return writer.Finish();
+        });
+}
+
+// Each row of indices is widened on its own, it's a quarter of an RGBA one
+auto WriteIndexedPng(const std::string& path, std::span<const Color> canvas,
+                     const Palette& palette, std::size_t canvas_width,
+                     std::size_t factor) -> bool
+{
+    const auto width = canvas_width * factor;
+    const auto canvas_height = canvas.size() / canvas_width;
+    std::vector<uint8_t> indices(canvas.size());
+    palette.ToIndices(canvas, indices);
+    std::vector<uint8_t> row(width);
+
+    return WriteFileAtomically(
+        path,
+        [&](std::ostream& out)
+        {
+            PngWriter writer{out, static_cast<uint32_t>(width),
+                             static_cast<uint32_t>(canvas_height * factor),
+                             palette.GetColors()};
+
+            for (std::size_t i = 0; i < indices.size(); i += canvas_width)
+            {
+                Upscale::WidenRow(row.data(), &indices[i], canvas_width,
+                                  factor);
+
+                if (!writer.WriteRow(std::span<const uint8_t>{row}, factor))
+                {
+                    return false;
+                }
+            }
+
+            return writer.Finish();
+        });
+}
+
+// How long since 'start' and how big the file at 'path' is
+auto MakeExportReport(const std::string& path,
+                      std::chrono::steady_clock::time_point start,
+                      std::size_t palette_size) -> Project::ImageExportReport
+{
+    // Only reported, 0 if it can't be had
+    std::error_code error;
+    const auto byte_size = std::filesystem::file_size(path, error);
+    return {.encode_seconds = std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count(),
+            .byte_size = error ? 0 : byte_size,
+            .palette_size = palette_size};
+}
+
+// For when the output has to be what stb writes. The whole magnified image
+// is built first.
+auto WriteStbPng(const std::string& path, std::span<const Color> canvas,
+                 std::size_t canvas_width, std::size_t factor) -> bool
+{
+    const auto width = canvas_width * factor;
+    const auto height = canvas.size() / canvas_width * factor;
+
+    // stb takes the sizes as int
+    if (width * height * sizeof(Color) >
+        static_cast<std::size_t>(std::numeric_limits<int>::max()))
+    {
+#ifndef NDEBUG
+        std::cerr << "The image is too big for stb_image_write, in "
+                     "WriteStbPng(...)\n";
+#endif
+        return false;
+    }
+
+    std::vector<Color> image(width * height);
+    Upscale::UpscaleImage(image, canvas, canvas_width, factor);
+
+    return WriteFileAtomically(
+        path,
+        [&](std::ostream& out)
+        {
+            const auto write = [](void* context, void* data, int size)
+            {
+                static_cast<std::ostream*>(context)->write(
+                    static_cast<const char*>(data), size);
+            };
+
+            return stbi_write_png_to_func(
+                       write, &out, static_cast<int>(width),
+                       static_cast<int>(height), sizeof(Color), image.data(),
+                       static_cast<int>(width * sizeof(Color))) != 0 &&
+                   static_cast<bool>(out);
+        });
+}
+} // namespace
+
 Project::Project(Layers& layers, Tool& tool, Camera& camera)
-    : mLayers{layers}, mTool{tool}, mCamera{camera}
+    : mLayers{layers}, mTool{tool}, mCamera{camera},
+      mAutosave{std::make_unique<AutosaveJournal>()}
 {
 }
 
+Project::~Project()
+{
+    // Kept for the next run only if there's something to recover
+    if (!mAutosave->HasEdits()) { mAutosave->Stop(); }
+}
+
 void Project::New(Vec2Int canvas_dims)
+{
+    Reset(canvas_dims);
+    RestartHistoryJournal();
+    RestartAutosave();
+}
+
+void Project::Reset(Vec2Int canvas_dims)
 {
     if (mProjectOpened)
     {
@@ -32,10 +256,14 @@ void Project::New(Vec2Int canvas_dims)
     mCanvasWidth = canvas_dims.x;
     mCanvasHeight = canvas_dims.y;
 
+    // A save still running belongs to the document before
+    ApplySaveResult(true);
+
     mProjectOpened = true;
+    mFilePath.clear();
 
     Layer::ResetConstructCounter();
-    Layer::SetUpdateWholeVBOToTrue();
+    Layer::SetUpdateWholeCanvasToTrue();
     mTool.get().SetDataToDefault();
     mLayers.get().SetCanvasDims(canvas_dims);
     mLayers.get().InitHistory(mCamera, mTool);
@@ -45,6 +273,75 @@ void Project::New(Vec2Int canvas_dims)
 
 void Project::Open(const std::string& project_file_dest)
 {
+    // It has the edits made since the file was last saved
+    const auto autosave_path =
+        project_file_dest + std::string{kAutosaveExtension};
+
+    if (IsNewer(autosave_path, project_file_dest) &&
+        OpenAutosave(autosave_path))
+    {
+        mFilePath = project_file_dest;
+        RestartHistoryJournal();
+        RestartAutosave();
+        return;
+    }
+
+    // Binary projects are mapped and only their tables are read here, the
+    // tiles get decoded once they're drawn or edited
+    auto mapping = std::make_shared<MappedFile>();
+
+    if (mapping->Map(project_file_dest) && Qoi::IsQoi(mapping->GetData()))
+    {
+        (void)ImportQoi(project_file_dest);
+        return;
+    }
+
+    if (mapping->IsMapped() && Pkz::IsBinaryProject(mapping->GetData()))
+    {
+        auto tables = Pkz::ParseTables(mapping->GetData());
+
+        if (!tables.has_value())
+        {
+#ifndef NDEBUG
+            std::cerr << "Invalid project file, at Project::Open(const "
+                         "std::string&)\n";
+#endif
+            return;
+        }
+
+        const Vec2Int canvas_dims{static_cast<int>(tables->width),
+                                  static_cast<int>(tables->height)};
+        Project::Reset(canvas_dims);
+        mFilePath = project_file_dest;
+        auto& layers = mLayers.get().GetLayers();
+        layers.clear();
+        Layer::ResetConstructCounter();
+
+        for (auto& layer_entry : tables->layers)
+        {
+            auto& layer = layers.emplace_back(mTool, mCamera, canvas_dims);
+            layer.mOpacity =
+                static_cast<int>(std::min(layer_entry.opacity, 255U));
+
+            for (std::size_t i = 0; i < layer_entry.chunks.size(); i++)
+            {
+                if (layer_entry.chunks[i].codec != Pkz::ChunkCodec::kEmpty)
+                {
+                    layer.mCanvas.SetTileHandle(i, nullptr);
+                }
+            }
+
+            layer.mCanvas.SetTileLoader(
+                MakeTileLoader(mapping, std::move(layer_entry.chunks)));
+        }
+
+        mLayers.get().DiscardPendingChanges();
+        RestartHistoryJournal();
+        RestartAutosave(true);
+        return;
+    }
+
+    // Version 1, plain text
     std::ifstream proj_file(project_file_dest);
 
     if (!proj_file.is_open())
@@ -74,8 +371,9 @@ void Project::Open(const std::string& project_file_dest)
     }
 
     Vec2Int canvas_dims{width, height};
-    Project::New(canvas_dims);
-    auto& layers = mLayers.get().GetCapture().layers;
+    Project::Reset(canvas_dims);
+    mFilePath = project_file_dest;
+    auto& layers = mLayers.get().GetLayers();
     layers.clear();
     Layer::ResetConstructCounter();
 
@@ -128,92 +426,443 @@ void Project::Open(const std::string& project_file_dest)
         }
     }
 
+    // The loaded pixels are the root of the undo tree, not a change
+    mLayers.get().DiscardPendingChanges();
     proj_file.close();
+    RestartHistoryJournal();
+    RestartAutosave();
+}
+
+auto Project::OpenAutosave(const std::string& autosave_path) -> bool
+{
+    auto recovered = AutosaveJournal::Recover(autosave_path);
+
+    if (!recovered.has_value())
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't recover anything from: " << autosave_path
+                  << " in Project::OpenAutosave(const std::string&)\n";
+#endif
+        return false;
+    }
+
+    Project::Reset(recovered->canvas_dims);
+    auto& layers = mLayers.get().GetLayers();
+    layers.clear();
+    Layer::ResetConstructCounter();
+
+    for (auto& recovered_layer : recovered->layers)
+    {
+        auto& layer =
+            layers.emplace_back(mTool, mCamera, recovered->canvas_dims);
+        layer.mOpacity =
+            static_cast<int>(std::min(recovered_layer.opacity, 255U));
+
+        for (std::size_t i = 0; i < recovered_layer.tiles.size(); i++)
+        {
+            layer.mCanvas.SetTileHandle(i, std::move(recovered_layer.tiles[i]));
+        }
+    }
+
+    mLayers.get().DiscardPendingChanges();
+    return true;
+}
+
+void Project::RecoverUnsavedProject()
+{
+    if (OpenAutosave(GetSidecarPath({}, kAutosaveExtension,
+                                    kUnsavedAutosaveName)))
+    {
+        RestartHistoryJournal();
+        RestartAutosave();
+    }
+}
+
+auto Project::HasUnsavedProjectToRecover() -> bool
+{
+    std::error_code error;
+    return std::filesystem::exists(
+        GetSidecarPath({}, kAutosaveExtension, kUnsavedAutosaveName), error);
 }
 
-auto Project::SaveAsImage(int magnify_factor,
-                          const std::string& save_dest) const -> bool
+auto Project::GetHistoryJournalPath() const -> std::string
 {
-    constexpr int kChannelCount = 4;
-    int arr_height = mCanvasHeight * magnify_factor;
-    int arr_width = mCanvasWidth * magnify_factor * kChannelCount;
-    std::vector<uint8_t> image_data(
-        static_cast<size_t>(arr_height * arr_width));
+    return GetSidecarPath(mFilePath, ".journal", "pikzel_history.journal");
+}
+
+auto Project::GetAutosavePath() const -> std::string
+{
+    return GetSidecarPath(mFilePath, kAutosaveExtension, kUnsavedAutosaveName);
+}
+
+void Project::UpdateAutosave()
+{
+    const auto changed_tiles = mLayers.get().TakeChangedTiles();
+    const auto& layers = std::as_const(mLayers.get()).GetLayers();
+    mAutosave->Append(layers, changed_tiles);
+    ApplySaveResult();
+}
+
+void Project::ApplySaveResult(bool should_wait /*= false*/)
+{
+    if (mSaveState == nullptr || mSaveState->is_applied) { return; }
+
+    if (should_wait && mSaveDone.valid()) { mSaveDone.wait(); }
+    else if (IsSaving()) { return; }
+
+    mSaveState->is_applied = true;
+    const bool has_succeeded = mSaveState->has_succeeded.load();
+
+    if (has_succeeded) { mFilePath = mSaveState->path; }
+
+    mAutosave->EndSave(GetAutosavePath(), mFilePath,
+                       std::as_const(mLayers.get()).GetLayers(),
+                       has_succeeded);
+}
+
+void Project::SetAutosaveEnabled(bool is_enabled)
+{
+    mIsAutosaveEnabled = is_enabled;
+
+    if (!is_enabled) { mAutosave->Stop(); }
+    else if (mProjectOpened) { RestartAutosave(); }
+}
+
+void Project::RestartHistoryJournal()
+{
+    auto& layers = mLayers.get();
+
+    if (!layers.IsHistoryJournalEnabled()) { return; }
+
+    // Deletes the journal of the document before. If the new one can't be
+    // created, the history just stays in memory.
+    (void)layers.EnableHistoryJournal(GetHistoryJournalPath());
+}
+
+void Project::RestartAutosave(bool is_file_up_to_date /*= false*/)
+{
+    // Those are in the snapshot
+    (void)mLayers.get().TakeChangedTiles();
+
+    if (!mIsAutosaveEnabled) { return; }
+
+    const auto& layers = std::as_const(mLayers.get()).GetLayers();
+
+    // Saves decoding the tiles for the snapshot
+    if (is_file_up_to_date)
+    {
+        (void)mAutosave->StartFromProjectFile(GetAutosavePath(), mFilePath,
+                                              GetCanvasDims(), layers);
+        return;
+    }
+
+    (void)mAutosave->Start(GetAutosavePath(), GetCanvasDims(), layers);
+}
+
+auto Project::SaveAsImage(int magnify_factor, const std::string& save_dest,
+                          PngEncoder encoder /*= PngEncoder::kFast*/) const
+    -> std::optional<ImageExportReport>
+{
+    if (magnify_factor < 1) { return std::nullopt; }
+
+    const auto factor = static_cast<std::size_t>(magnify_factor);
+    const auto canvas_width = static_cast<std::size_t>(mCanvasWidth);
+    const auto width = canvas_width * factor;
+    const auto height = static_cast<std::size_t>(mCanvasHeight) * factor;
+
+    if (width > PngWriter::kMaxDimension || height > PngWriter::kMaxDimension)
+    {
+#ifndef NDEBUG
+        std::cerr << "The image would be too big for a PNG, in "
+                     "Project::SaveAsImage(int, const std::string&, "
+                     "PngEncoder)\n";
+#endif
+        return std::nullopt;
+    }
 
     const CanvasData& canvas_displayed = mLayers.get().GetDisplayedCanvas();
+    const auto start = std::chrono::steady_clock::now();
+    std::size_t palette_size = 0;
+    bool has_succeeded = false;
+
+    if (encoder == PngEncoder::kStb)
+    {
+        has_succeeded =
+            WriteStbPng(save_dest, canvas_displayed, canvas_width, factor);
+    }
+    // Pixel art seldom has more than 256 colors, an indexed PNG is up to 4
+    // times smaller then
+    else if (const auto palette = Palette::Find(canvas_displayed))
+    {
+        palette_size = palette->GetColors().size();
+        has_succeeded = WriteIndexedPng(save_dest, canvas_displayed, *palette,
+                                        canvas_width, factor);
+    }
+    else
+    {
+        has_succeeded = WriteStreamedPng(save_dest, canvas_displayed,
+                                         canvas_width, factor);
+    }
+
+    if (!has_succeeded) { return std::nullopt; }
+
+    return MakeExportReport(save_dest, start, palette_size);
+}
 
-    for (int i = 0; i < mCanvasHeight; i++)
+auto Project::SaveAsQoi(
+    int magnify_factor, const std::string& save_dest,
+    std::optional<std::size_t> layer_index /*= std::nullopt*/) const
+    -> std::optional<ImageExportReport>
+{
+    if (magnify_factor < 1) { return std::nullopt; }
+
+    const auto factor = static_cast<std::size_t>(magnify_factor);
+    const auto canvas_width = static_cast<std::size_t>(mCanvasWidth);
+    const auto canvas_height = static_cast<std::size_t>(mCanvasHeight);
+    const auto width = canvas_width * factor;
+    const auto height = canvas_height * factor;
+
+    // One at a time first, the product could wrap. The limit is below
+    // UINT32_MAX, so the dims fit in the header too.
+    if (width > Qoi::kMaxPixelCount || height > Qoi::kMaxPixelCount ||
+        width * height > Qoi::kMaxPixelCount)
+    {
+#ifndef NDEBUG
+        std::cerr << "The image would be too big for QOI, in "
+                     "Project::SaveAsQoi(int, const std::string&, "
+                     "std::optional<std::size_t>)\n";
+#endif
+        return std::nullopt;
+    }
+
+    const auto& layers = std::as_const(mLayers.get()).GetLayers();
+
+    if (layer_index.has_value() && *layer_index >= layers.size())
+    {
+        return std::nullopt;
+    }
+
+    // A source row at a time, from the flattened canvas or copied out of
+    // the layer's tiles, so there's never a whole image in memory
+    std::vector<Color> source_row(canvas_width);
+    std::function<std::span<const Color>(int)> read_row;
+
+    if (layer_index.has_value())
+    {
+        const auto& layer = *std::next(
+            layers.begin(), static_cast<std::ptrdiff_t>(*layer_index));
+        read_row = [&](int row)
+        {
+            layer.CopyRectTo({.upper_left = {0, row},
+                              .bottom_right = {mCanvasWidth, row + 1}},
+                             source_row.data());
+            return std::span<const Color>{source_row};
+        };
+    }
+    else
     {
-        for (int j = 0; j < mCanvasWidth; j++)
+        const CanvasData& canvas_displayed =
+            mLayers.get().GetDisplayedCanvas();
+        read_row = [&](int row)
         {
-            Color pixel_color = canvas_displayed[(i * mCanvasWidth) + j];
-            for (int k = 0; k < magnify_factor; k++)
+            return std::span{canvas_displayed}.subspan(
+                static_cast<std::size_t>(row) * canvas_width, canvas_width);
+        };
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<Color> widened(width);
+
+    const bool has_succeeded = WriteFileAtomically(
+        save_dest,
+        [&](std::ostream& out)
+        {
+            Qoi::Writer writer{out, static_cast<uint32_t>(width),
+                               static_cast<uint32_t>(height)};
+
+            for (int row = 0; row < mCanvasHeight; row++)
             {
-                // NOLINTNEXTLINE(readability-identifier-length)
-                for (int l = 0; l < magnify_factor; l++)
-                {
-                    image_data[((i * magnify_factor + k) * arr_width) +
-                               (j * magnify_factor * kChannelCount) +
-                               (l * kChannelCount) + 0] = pixel_color.r;
-                    image_data[((i * magnify_factor + k) * arr_width) +
-                               (j * magnify_factor * kChannelCount) +
-                               (l * kChannelCount) + 1] = pixel_color.g;
-                    image_data[((i * magnify_factor + k) * arr_width) +
-                               (j * magnify_factor * kChannelCount) +
-                               (l * kChannelCount) + 2] = pixel_color.b;
-                    image_data[((i * magnify_factor + k) * arr_width) +
-                               (j * magnify_factor * kChannelCount) +
-                               (l * kChannelCount) + 3] = pixel_color.a;
-                }
+                Upscale::WidenRow(widened.data(), read_row(row).data(),
+                                  canvas_width, factor);
+
+                if (!writer.WriteRow(widened, factor)) { return false; }
             }
-        }
-    }
 
-    int height = mCanvasHeight * magnify_factor;
-    int width = mCanvasWidth * magnify_factor;
+            return writer.Finish();
+        });
 
-    return stbi_write_png(save_dest.c_str(), width, height, kChannelCount,
-                          image_data.data(), width * kChannelCount) != 0;
+    if (!has_succeeded) { return std::nullopt; }
+
+    return MakeExportReport(save_dest, start, 0);
 }
 
-void Project::SaveAsProject(const std::string& save_dest)
+auto Project::ImportQoi(const std::string& qoi_path) -> bool
 {
-    std::ofstream save_file(save_dest + ".pkz");
+    MappedFile file;
+    std::optional<Qoi::Reader> reader;
+
+    if (file.Map(qoi_path)) { reader.emplace(file.GetData()); }
+
+    // Canvas coords are ints, and the tile count is rounded up
+    constexpr auto kMaxDimension =
+        static_cast<uint32_t>(std::numeric_limits<int>::max() -
+                              TiledCanvas::kTileSize);
 
-    if (!save_file.is_open())
+    if (!reader.has_value() || reader->HasFailed() ||
+        reader->GetWidth() > kMaxDimension ||
+        reader->GetHeight() > kMaxDimension)
     {
 #ifndef NDEBUG
-        std::cerr << "Couldn't open the file in "
-                     "Project::SaveAsProject(std::string save_dest)"
-                  << "\nFile: " << __FILE__ << "\nLine: " << __LINE__ << '\n';
+        std::cerr << "Couldn't read a QOI image from: " << qoi_path
+                  << " in Project::ImportQoi(const std::string&)\n";
 #endif
-        return;
+        return false;
     }
 
-    auto& layers = mLayers.get().GetCapture().layers;
-    save_file << static_cast<std::size_t>(layers.size()) << " ";
-    save_file << Project::CanvasWidth() << " ";
-    save_file << Project::CanvasHeight() << "\n";
+    const Vec2Int canvas_dims{static_cast<int>(reader->GetWidth()),
+                              static_cast<int>(reader->GetHeight())};
+    const auto width = static_cast<std::size_t>(canvas_dims.x);
 
-    for (auto& layer : layers)
+    // Decoded into tiles first, a broken file leaves the project as it is.
+    // A band of rows, one tile high, is decoded at a time.
+    TiledCanvas canvas{canvas_dims};
+    std::vector<Color> band(width * TiledCanvas::kTileSize);
+
+    for (int band_y = 0; band_y < canvas_dims.y;
+         band_y += TiledCanvas::kTileSize)
     {
-        save_file << layer.GetOpacity() << "\n";
-        // save_file << layer.GetName() << "\n";
+        const auto row_count =
+            std::min(TiledCanvas::kTileSize, canvas_dims.y - band_y);
+
+        for (int row = 0; row < row_count; row++)
+        {
+            if (!reader->ReadRow(std::span{band}.subspan(
+                    static_cast<std::size_t>(row) * width, width)))
+            {
+#ifndef NDEBUG
+                std::cerr << "The QOI image is truncated: " << qoi_path
+                          << " in Project::ImportQoi(const std::string&)\n";
+#endif
+                return false;
+            }
+        }
 
-        for (Color col : layer.GetCanvas())
+        for (int tile_x = 0; tile_x < canvas_dims.x;
+             tile_x += TiledCanvas::kTileSize)
         {
-            save_file << col.r << " ";
-            save_file << col.g << " ";
-            save_file << col.b << " ";
-            save_file << col.a << "\n";
+            const auto tile_index = canvas.TileIndexOf({tile_x, band_y});
+            const auto rect = canvas.GetTileRect(tile_index);
+            const auto tile_width = static_cast<std::size_t>(rect.Width());
+            auto tile = std::make_shared<TiledCanvas::Tile>();
+
+            for (int row = 0; row < row_count; row++)
+            {
+                std::copy_n(
+                    &band[(static_cast<std::size_t>(row) * width) +
+                          static_cast<std::size_t>(tile_x)],
+                    tile_width,
+                    &(*tile)[TiledCanvas::PixelIndexInTile({0, row})]);
+            }
+
+            if (*tile != *TiledCanvas::GetEmptyTile())
+            {
+                canvas.SetTileHandle(tile_index, std::move(tile));
+            }
         }
     }
 
-    save_file.close();
+    Project::Reset(canvas_dims);
+    auto& layers = mLayers.get().GetLayers();
+    layers.clear();
+    Layer::ResetConstructCounter();
+    auto& layer = layers.emplace_back(mTool, mCamera, canvas_dims);
+
+    for (std::size_t i = 0; i < canvas.GetTileCount(); i++)
+    {
+        layer.mCanvas.SetTileHandle(i, canvas.GetTileHandle(i));
+    }
+
+    mLayers.get().DiscardPendingChanges();
+    RestartHistoryJournal();
+    RestartAutosave();
+    return true;
+}
+
+void Project::SaveAsProject(const std::string& save_dest)
+{
+    // One at a time, the second one would race for the same temporary file
+    ApplySaveResult(true);
+
+    // The file written to could be the one the tiles are loaded from
+    mLayers.get().LoadAllTiles();
+
+    mAutosave->BeginSave(mLayers.get().GetLayers());
+
+    // Copying the handles is all it takes, tiles drawn on meanwhile get
+    // cloned
+    std::vector<Pkz::LayerSnapshot> snapshot;
+
+    for (const auto& layer : mLayers.get().GetLayers())
+    {
+        const auto& canvas = layer.GetCanvas();
+        auto& layer_snapshot = snapshot.emplace_back(
+            static_cast<uint32_t>(layer.GetOpacity()),
+            std::vector<TiledCanvas::TileHandle>{});
+
+        for (std::size_t i = 0; i < canvas.GetTileCount(); i++)
+        {
+            layer_snapshot.tiles.push_back(canvas.GetTileHandle(i));
+        }
+    }
+
+    // The project points there once it's written, see ApplySaveResult
+    mSaveState = std::make_shared<SaveState>();
+    mSaveState->path = save_dest + ".pkz";
+    mSaveDone = ThreadPool::Get().Submit(
+        [state = mSaveState, path = mSaveState->path,
+         canvas_dims = GetCanvasDims(), snapshot = std::move(snapshot)]
+        {
+            const bool has_succeeded = WriteFileAtomically(
+                path,
+                [&](std::ostream& out)
+                {
+                    return Pkz::WriteProject(out, canvas_dims, snapshot,
+                                             &state->progress);
+                });
+
+#ifndef NDEBUG
+            if (!has_succeeded)
+            {
+                std::cerr << "Couldn't write the project in "
+                             "Project::SaveAsProject(std::string save_dest)"
+                          << "\nFile: " << __FILE__ << "\nLine: " << __LINE__
+                          << '\n';
+            }
+#endif
+
+            state->has_succeeded.store(has_succeeded);
+        });
+}
+
+auto Project::IsSaving() const -> bool
+{
+    return mSaveDone.valid() && mSaveDone.wait_for(std::chrono::seconds{0}) !=
+                                    std::future_status::ready;
+}
+
+auto Project::TakeSaveResult() -> std::optional<bool>
+{
+    if (!mSaveDone.valid() || IsSaving()) { return std::nullopt; }
+
+    ApplySaveResult();
+    mSaveDone.get();
+    return mSaveState->has_succeeded.load();
 }
 
 void Project::CloseCurrentProject()
 {
+    ApplySaveResult(true);
+    mAutosave->Stop();
     mLayers.get().ResetDataToDefault();
     mTool.get().SetDataToDefault();
     mProjectOpened = false;
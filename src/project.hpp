@@ -4,25 +4,77 @@
 
 #include <glm/vec2.hpp>
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <optional>
 #include <string>
 
 namespace Pikzel
 {
 using Vec2Int = glm::vec<2, int>;
 
+class AutosaveJournal;
 class Layers;
 class Tool;
 
 class Project
 {
   public:
+    enum class PngEncoder
+    {
+        // Streamed and compressed on the thread pool. Indexed if there
+        // are few enough colors.
+        kFast,
+        // stb_image_write, needs the whole image in memory
+        kStb,
+    };
+
+    struct ImageExportReport
+    {
+        double encode_seconds = 0.0;
+        std::uintmax_t byte_size = 0;
+        // 0 if the image is RGBA
+        std::size_t palette_size = 0;
+    };
+
     Project(Layers& layers, Tool& tool, Camera& camera);
+    Project(const Project&) = delete;
+    Project(Project&&) = delete;
+    auto operator=(const Project&) -> Project& = delete;
+    auto operator=(Project&&) -> Project& = delete;
+    ~Project();
+
     void New(Vec2Int canvas_dims);
+    // Recovers the autosave of the file instead, if it's newer. Imports a
+    // QOI image, see ImportQoi.
     void Open(const std::string& project_file_dest);
+    // Reads the layers back from an autosave journal
+    auto OpenAutosave(const std::string& autosave_path) -> bool;
+    // Opens the project which was never saved to a file, as it was when
+    // the app last ran
+    void RecoverUnsavedProject();
+    [[nodiscard]] static auto HasUnsavedProjectToRecover() -> bool;
+    // Returns right away. The layers are snapshotted and written on a
+    // worker, see IsSaving and TakeSaveResult.
     void SaveAsProject(const std::string& save_dest);
     void CloseCurrentProject();
+    // Returns how long it took and how big the file is, if it succeeded
     [[nodiscard]] auto SaveAsImage(int magnify_factor,
-                                   const std::string& save_dest) const -> bool;
+                                   const std::string& save_dest,
+                                   PngEncoder encoder = PngEncoder::kFast) const
+        -> std::optional<ImageExportReport>;
+    // Flattened, or only the layer at 'layer_index', with its pixels as
+    // they are. Faster to write and read than PNG.
+    [[nodiscard]] auto SaveAsQoi(
+        int magnify_factor, const std::string& save_dest,
+        std::optional<std::size_t> layer_index = std::nullopt) const
+        -> std::optional<ImageExportReport>;
+    // Opens the image as a new project with one layer. Open does so too, for
+    // a QOI file.
+    auto ImportQoi(const std::string& qoi_path) -> bool;
 
     [[nodiscard]] auto IsOpened() const -> bool { return mProjectOpened; }
     [[nodiscard]] auto CanvasHeight() const -> int { return mCanvasHeight; }
@@ -31,11 +83,63 @@ class Project
     {
         return {mCanvasWidth, mCanvasHeight};
     }
+    [[nodiscard]] auto IsSaving() const -> bool;
+    // From 0 to 1
+    [[nodiscard]] auto GetSaveProgress() const -> float
+    {
+        return mSaveState != nullptr ? mSaveState->progress.load() : 0.0F;
+    }
+    // Whether the last save succeeded, once it finished. Returned only once.
+    auto TakeSaveResult() -> std::optional<bool>;
+    // Empty until the project is opened from or saved to a file
+    [[nodiscard]] auto GetFilePath() const -> const std::string&
+    {
+        return mFilePath;
+    }
+    // Next to the project file, or in the temp dir if there's none
+    [[nodiscard]] auto GetHistoryJournalPath() const -> std::string;
+    [[nodiscard]] auto GetAutosavePath() const -> std::string;
+    // Appends the edits committed since the last call to the autosave
+    // journal. Call once per frame.
+    void UpdateAutosave();
+    void SetAutosaveEnabled(bool is_enabled);
+    [[nodiscard]] auto IsAutosaveEnabled() const -> bool
+    {
+        return mIsAutosaveEnabled;
+    }
 
   private:
+    // New, but leaves the autosave as it is
+    void Reset(Vec2Int canvas_dims);
+    // Starts the autosave over with the current layers, at the current path.
+    // With 'is_file_up_to_date' the project file stands in for the layers.
+    void RestartAutosave(bool is_file_up_to_date = false);
+    // Moves the history journal, if it's enabled, next to the document
+    // just created or opened
+    void RestartHistoryJournal();
+
+    // Points the project at the file saved to, once the save succeeded,
+    // and lets the autosave know. With 'should_wait' waits for the save.
+    void ApplySaveResult(bool should_wait = false);
+
+    // Shared with the worker doing the save
+    struct SaveState
+    {
+        std::atomic<float> progress{0.0F};
+        std::atomic<bool> has_succeeded{false};
+        // Only read on the main thread
+        std::string path;
+        bool is_applied = false;
+    };
+
     std::reference_wrapper<Layers> mLayers;
     std::reference_wrapper<Tool> mTool;
     std::reference_wrapper<Camera> mCamera;
+    std::string mFilePath;
+    std::shared_ptr<SaveState> mSaveState;
+    std::future<void> mSaveDone;
+    std::unique_ptr<AutosaveJournal> mAutosave;
+    bool mIsAutosaveEnabled = true;
     bool mProjectOpened = false;
     int mCanvasHeight = 0;
     int mCanvasWidth = 0;
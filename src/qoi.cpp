@@ -0,0 +1,273 @@
+#include "qoi.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace Pikzel::Qoi
+{
+namespace
+{
+constexpr std::array<char, 4> kMagic = {'q', 'o', 'i', 'f'};
+constexpr std::size_t kHeaderSize = 14;
+constexpr std::array<uint8_t, 8> kEndMarker = {0, 0, 0, 0, 0, 0, 0, 1};
+constexpr uint8_t kChannelCount = 4;
+// sRGB with linear alpha
+constexpr uint8_t kColorSpace = 0;
+
+constexpr uint8_t kOpIndex = 0x00;
+constexpr uint8_t kOpDiff = 0x40;
+constexpr uint8_t kOpLuma = 0x80;
+constexpr uint8_t kOpRun = 0xC0;
+constexpr uint8_t kOpRgb = 0xFE;
+constexpr uint8_t kOpRgba = 0xFF;
+constexpr uint8_t kOpMask = 0xC0;
+// Stored as length - 1, 63 and 64 would clash with kOpRgb and kOpRgba
+constexpr uint32_t kMaxRunLength = 62;
+
+auto GetIndexPosition(Color color) -> std::size_t
+{
+    return ((color.r * 3U) + (color.g * 5U) + (color.b * 7U) +
+            (color.a * 11U)) %
+           64U;
+}
+
+// QOI numbers are big endian
+void AppendBigEndian(uint32_t value, std::vector<std::byte>& dst)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        dst.push_back(static_cast<std::byte>(value >> shift));
+    }
+}
+
+// The difference wraps around, as the format wants
+auto Difference(uint8_t value, uint8_t previous) -> int
+{
+    return static_cast<int8_t>(static_cast<uint8_t>(value - previous));
+}
+} // namespace
+
+auto IsQoi(std::span<const std::byte> data) -> bool
+{
+    return data.size() >= kHeaderSize &&
+           std::ranges::equal(data.first(kMagic.size()),
+                              std::as_bytes(std::span{kMagic}));
+}
+
+Writer::Writer(std::ostream& out, uint32_t width, uint32_t height)
+    : mOut{out}, mWidth{width}, mHeight{height}
+{
+    assert(width != 0 && height != 0);
+    assert(std::size_t{width} * height <= kMaxPixelCount);
+
+    mBuffer.reserve(kBufferSize);
+    const auto magic = std::as_bytes(std::span{kMagic});
+    mBuffer.insert(mBuffer.end(), magic.begin(), magic.end());
+    AppendBigEndian(width, mBuffer);
+    AppendBigEndian(height, mBuffer);
+    mBuffer.push_back(std::byte{kChannelCount});
+    mBuffer.push_back(std::byte{kColorSpace});
+}
+
+auto Writer::WriteRow(std::span<const Color> row,
+                      std::size_t count /*= 1*/) -> bool
+{
+    assert(row.size() == mWidth);
+    assert(count != 0 && count <= mHeight - mRowsWritten);
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        for (const auto pixel : row) { WritePixel(pixel); }
+
+        if (mBuffer.size() >= kBufferSize) { Flush(); }
+    }
+
+    mRowsWritten += static_cast<uint32_t>(count);
+    return static_cast<bool>(mOut.get());
+}
+
+auto Writer::Finish() -> bool
+{
+    assert(mRowsWritten == mHeight);
+
+    FlushRun();
+
+    for (const auto byte : kEndMarker)
+    {
+        mBuffer.push_back(static_cast<std::byte>(byte));
+    }
+
+    Flush();
+    return static_cast<bool>(mOut.get());
+}
+
+void Writer::WritePixel(Color pixel)
+{
+    if (pixel == mPrevious)
+    {
+        if (++mRunLength == kMaxRunLength) { FlushRun(); }
+        return;
+    }
+
+    FlushRun();
+
+    const auto index_position = GetIndexPosition(pixel);
+    const auto previous = std::exchange(mPrevious, pixel);
+
+    if (mIndex[index_position] == pixel)
+    {
+        mBuffer.push_back(static_cast<std::byte>(kOpIndex | index_position));
+        return;
+    }
+
+    mIndex[index_position] = pixel;
+
+    if (pixel.a != previous.a)
+    {
+        mBuffer.push_back(std::byte{kOpRgba});
+
+        for (const auto channel : {pixel.r, pixel.g, pixel.b, pixel.a})
+        {
+            mBuffer.push_back(static_cast<std::byte>(channel));
+        }
+
+        return;
+    }
+
+    const auto dr = Difference(pixel.r, previous.r);
+    const auto dg = Difference(pixel.g, previous.g);
+    const auto db = Difference(pixel.b, previous.b);
+    const auto dr_dg = dr - dg;
+    const auto db_dg = db - dg;
+
+    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+    {
+        mBuffer.push_back(static_cast<std::byte>(
+            kOpDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+    }
+    else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 &&
+             db_dg >= -8 && db_dg <= 7)
+    {
+        mBuffer.push_back(static_cast<std::byte>(kOpLuma | (dg + 32)));
+        mBuffer.push_back(
+            static_cast<std::byte>(((dr_dg + 8) << 4) | (db_dg + 8)));
+    }
+    else
+    {
+        mBuffer.push_back(std::byte{kOpRgb});
+
+        for (const auto channel : {pixel.r, pixel.g, pixel.b})
+        {
+            mBuffer.push_back(static_cast<std::byte>(channel));
+        }
+    }
+}
+
+void Writer::FlushRun()
+{
+    if (mRunLength == 0) { return; }
+
+    mBuffer.push_back(static_cast<std::byte>(kOpRun | (mRunLength - 1)));
+    mRunLength = 0;
+}
+
+void Writer::Flush()
+{
+    mOut.get().write(reinterpret_cast<const char*>(mBuffer.data()),
+                     static_cast<std::streamsize>(mBuffer.size()));
+    mBuffer.clear();
+}
+
+Reader::Reader(std::span<const std::byte> data) : mData{data}
+{
+    if (!IsQoi(data))
+    {
+        mHasFailed = true;
+        return;
+    }
+
+    mPos = kMagic.size();
+
+    for (auto* dim : {&mWidth, &mHeight})
+    {
+        for (int i = 0; i < 4; i++) { *dim = (*dim << 8U) | ReadByte(); }
+    }
+
+    // Only RGBA is written, but RGB files read the same way
+    const auto channel_count = ReadByte();
+    const auto color_space = ReadByte();
+
+    if (mWidth == 0 || mHeight == 0 ||
+        std::size_t{mWidth} * mHeight > kMaxPixelCount ||
+        (channel_count != 3 && channel_count != kChannelCount) ||
+        color_space > 1)
+    {
+        mHasFailed = true;
+    }
+}
+
+auto Reader::ReadRow(std::span<Color> row) -> bool
+{
+    assert(row.size() == mWidth);
+
+    if (mHasFailed || mRowsRead == mHeight) { return false; }
+
+    for (auto& pixel : row) { pixel = ReadPixel(); }
+
+    mRowsRead++;
+    return !mHasFailed;
+}
+
+auto Reader::ReadPixel() -> Color
+{
+    if (mRunLength != 0)
+    {
+        mRunLength--;
+        return mPrevious;
+    }
+
+    const auto op = ReadByte();
+    auto pixel = mPrevious;
+
+    if (op == kOpRgb || op == kOpRgba)
+    {
+        pixel.r = ReadByte();
+        pixel.g = ReadByte();
+        pixel.b = ReadByte();
+        if (op == kOpRgba) { pixel.a = ReadByte(); }
+    }
+    else if ((op & kOpMask) == kOpIndex) { pixel = mIndex[op]; }
+    else if ((op & kOpMask) == kOpDiff)
+    {
+        pixel.r = static_cast<uint8_t>(pixel.r + ((op >> 4U) & 0x03U) - 2);
+        pixel.g = static_cast<uint8_t>(pixel.g + ((op >> 2U) & 0x03U) - 2);
+        pixel.b = static_cast<uint8_t>(pixel.b + (op & 0x03U) - 2);
+    }
+    else if ((op & kOpMask) == kOpLuma)
+    {
+        const int second = ReadByte();
+        const int dg = (op & 0x3F) - 32;
+        pixel.r = static_cast<uint8_t>(pixel.r + dg - 8 + (second >> 4));
+        pixel.g = static_cast<uint8_t>(pixel.g + dg);
+        pixel.b = static_cast<uint8_t>(pixel.b + dg - 8 + (second & 0x0F));
+    }
+    // The pixel itself is the first of the run
+    else { mRunLength = op & 0x3FU; }
+
+    mIndex[GetIndexPosition(pixel)] = pixel;
+    mPrevious = pixel;
+    return pixel;
+}
+
+auto Reader::ReadByte() -> uint8_t
+{
+    if (mPos == mData.size())
+    {
+        mHasFailed = true;
+        return 0;
+    }
+
+    return static_cast<uint8_t>(mData[mPos++]);
+}
+} // namespace Pikzel::Qoi
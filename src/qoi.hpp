@@ -0,0 +1,85 @@
+#pragma once
+
+#include "color.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <span>
+#include <vector>
+
+// The QOI image format, see qoiformat.org. Much faster to write and read
+// than PNG, at about the same size for pixel art.
+namespace Pikzel::Qoi
+{
+// Larger images are refused by the reference decoder
+constexpr std::size_t kMaxPixelCount = 400'000'000;
+
+[[nodiscard]] auto IsQoi(std::span<const std::byte> data) -> bool;
+
+// Writes the image a row at a time, nothing but the encoded bytes is held
+class Writer
+{
+  public:
+    // Writes the header right away
+    Writer(std::ostream& out, uint32_t width, uint32_t height);
+    Writer(const Writer&) = delete;
+    Writer(Writer&&) = delete;
+    auto operator=(const Writer&) -> Writer& = delete;
+    auto operator=(Writer&&) -> Writer& = delete;
+    ~Writer() = default;
+
+    // From the top, 'row' has to be 'width' pixels, written 'count' times
+    auto WriteRow(std::span<const Color> row, std::size_t count = 1) -> bool;
+    // Call once all the rows are written. Fails if any write failed.
+    auto Finish() -> bool;
+
+  private:
+    void WritePixel(Color pixel);
+    void FlushRun();
+    void Flush();
+
+    // Written to the stream in pieces of about this size
+    static constexpr std::size_t kBufferSize = 64UZ * 1024;
+
+    std::reference_wrapper<std::ostream> mOut;
+    uint32_t mWidth;
+    uint32_t mHeight;
+    uint32_t mRowsWritten = 0;
+    std::vector<std::byte> mBuffer;
+    std::array<Color, 64> mIndex{};
+    Color mPrevious{.r = 0, .g = 0, .b = 0, .a = 0xFF};
+    uint32_t mRunLength = 0;
+};
+
+// Decodes the image a row at a time, straight from 'data'
+class Reader
+{
+  public:
+    // Fails, see HasFailed, if 'data' doesn't start with a valid header
+    explicit Reader(std::span<const std::byte> data);
+
+    [[nodiscard]] auto GetWidth() const -> uint32_t { return mWidth; }
+    [[nodiscard]] auto GetHeight() const -> uint32_t { return mHeight; }
+    // From the top, 'row' has to be 'width' pixels. Fails if the data ends
+    // early.
+    auto ReadRow(std::span<Color> row) -> bool;
+    [[nodiscard]] auto HasFailed() const -> bool { return mHasFailed; }
+
+  private:
+    auto ReadPixel() -> Color;
+    auto ReadByte() -> uint8_t;
+
+    std::span<const std::byte> mData;
+    std::size_t mPos = 0;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+    uint32_t mRowsRead = 0;
+    std::array<Color, 64> mIndex{};
+    Color mPrevious{.r = 0, .g = 0, .b = 0, .a = 0xFF};
+    uint32_t mRunLength = 0;
+    bool mHasFailed = false;
+};
+} // namespace Pikzel::Qoi
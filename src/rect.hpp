@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+
+#include <algorithm>
+#include <cstddef>
+
+namespace Pikzel
+{
+using Vec2Int = glm::vec<2, int>;
+
+// Rectangle in canvas coordinates. The upper left corner is inclusive and the
+// bottom right one is exclusive, so a rect with equal corners is empty.
+struct Rect
+{
+    Vec2Int upper_left{0, 0};
+    Vec2Int bottom_right{0, 0};
+
+    [[nodiscard]] auto IsEmpty() const -> bool
+    {
+        return upper_left.x >= bottom_right.x || upper_left.y >= bottom_right.y;
+    }
+    [[nodiscard]] auto Width() const -> int
+    {
+        return IsEmpty() ? 0 : bottom_right.x - upper_left.x;
+    }
+    [[nodiscard]] auto Height() const -> int
+    {
+        return IsEmpty() ? 0 : bottom_right.y - upper_left.y;
+    }
+    [[nodiscard]] auto Area() const -> std::size_t
+    {
+        return static_cast<std::size_t>(Width()) *
+               static_cast<std::size_t>(Height());
+    }
+
+    void Include(Vec2Int coords)
+    {
+        Include(Rect{.upper_left = coords, .bottom_right = coords + 1});
+    }
+
+    void Include(Rect other)
+    {
+        if (other.IsEmpty()) { return; }
+        if (IsEmpty())
+        {
+            *this = other;
+            return;
+        }
+
+        upper_left.x = std::min(upper_left.x, other.upper_left.x);
+        upper_left.y = std::min(upper_left.y, other.upper_left.y);
+        bottom_right.x = std::max(bottom_right.x, other.bottom_right.x);
+        bottom_right.y = std::max(bottom_right.y, other.bottom_right.y);
+    }
+};
+
+[[nodiscard]] inline auto Intersect(Rect rect_a, Rect rect_b) -> Rect
+{
+    return {.upper_left = {std::max(rect_a.upper_left.x, rect_b.upper_left.x),
+                           std::max(rect_a.upper_left.y, rect_b.upper_left.y)},
+            .bottom_right = {
+                std::min(rect_a.bottom_right.x, rect_b.bottom_right.x),
+                std::min(rect_a.bottom_right.y, rect_b.bottom_right.y)}};
+}
+} // namespace Pikzel
@@ -0,0 +1,141 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace Pikzel
+{
+ThreadPool::ThreadPool(std::size_t thread_count /*= 0*/)
+{
+    if (thread_count == 0)
+    {
+        thread_count =
+            std::max(std::thread::hardware_concurrency(), 2U) - 1;
+    }
+
+    mWorkers.reserve(thread_count);
+
+    for (std::size_t i = 0; i < thread_count; i++)
+    {
+        mWorkers.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock{mMutex};
+        mStopping = true;
+    }
+
+    mJobAvailable.notify_all();
+
+    for (auto& worker : mWorkers) { worker.join(); }
+}
+
+void ThreadPool::ParallelFor(std::size_t task_count,
+                             const std::function<void(std::size_t)>& task)
+{
+    if (task_count == 0) { return; }
+
+    if (task_count == 1 || mWorkers.empty())
+    {
+        for (std::size_t i = 0; i < task_count; i++) { task(i); }
+        return;
+    }
+
+    // Helpers can start after every index got taken and this call returned,
+    // so they share the state instead of pointing into this stack frame
+    struct SharedState
+    {
+        std::atomic<std::size_t> next_index{0};
+        std::size_t done_count = 0;
+        std::mutex mutex;
+        std::condition_variable all_done;
+    };
+
+    auto state = std::make_shared<SharedState>();
+
+    // Grabs indices until there are none left
+    auto run = [state, &task, task_count]
+    {
+        std::size_t done = 0;
+
+        for (auto i = state->next_index.fetch_add(1); i < task_count;
+             i = state->next_index.fetch_add(1))
+        {
+            task(i);
+            done++;
+        }
+
+        if (done == 0) { return; }
+
+        std::lock_guard<std::mutex> lock{state->mutex};
+        state->done_count += done;
+        if (state->done_count == task_count) { state->all_done.notify_one(); }
+    };
+
+    const auto helper_count = std::min(task_count - 1, mWorkers.size());
+
+    {
+        std::lock_guard<std::mutex> lock{mMutex};
+        for (std::size_t i = 0; i < helper_count; i++) { mJobs.emplace(run); }
+    }
+
+    mJobAvailable.notify_all();
+    run();
+
+    std::unique_lock<std::mutex> lock{state->mutex};
+    state->all_done.wait(lock,
+                         [&] { return state->done_count == task_count; });
+}
+
+auto ThreadPool::Submit(std::function<void()> job) -> std::future<void>
+{
+    // std::function has to be copyable, the task isn't
+    auto task = std::make_shared<std::packaged_task<void()>>(std::move(job));
+    auto future = task->get_future();
+
+    if (mWorkers.empty())
+    {
+        (*task)();
+        return future;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{mMutex};
+        mJobs.emplace([task] { (*task)(); });
+    }
+
+    mJobAvailable.notify_one();
+    return future;
+}
+
+auto ThreadPool::Get() -> ThreadPool&
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::WorkerLoop()
+{
+    while (true)
+    {
+        std::function<void()> job;
+
+        {
+            std::unique_lock<std::mutex> lock{mMutex};
+            mJobAvailable.wait(lock,
+                               [this] { return mStopping || !mJobs.empty(); });
+
+            if (mStopping && mJobs.empty()) { return; }
+
+            job = std::move(mJobs.front());
+            mJobs.pop();
+        }
+
+        job();
+    }
+}
+} // namespace Pikzel
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace Pikzel
+{
+// Fixed set of worker threads, created once and reused, so CPU heavy work
+// like compositing or encoding can be split across all cores without paying
+// for thread creation every time.
+class ThreadPool
+{
+  public:
+    // 0 means one thread per hardware thread, minus the calling one
+    explicit ThreadPool(std::size_t thread_count = 0);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+    auto operator=(const ThreadPool&) -> ThreadPool& = delete;
+    auto operator=(ThreadPool&&) -> ThreadPool& = delete;
+    ~ThreadPool();
+
+    // Calls 'task' for every index in [0, task_count), spread across the
+    // workers and the calling thread. Returns once all the calls returned.
+    void ParallelFor(std::size_t task_count,
+                     const std::function<void(std::size_t)>& task);
+
+    // Runs 'job' on one of the workers, in the background. The future gets
+    // ready once it returned.
+    auto Submit(std::function<void()> job) -> std::future<void>;
+
+    // Workers plus the calling thread
+    [[nodiscard]] auto GetConcurrency() const -> std::size_t
+    {
+        return mWorkers.size() + 1;
+    }
+
+    // The pool shared by the whole app
+    static auto Get() -> ThreadPool&;
+
+  private:
+    void WorkerLoop();
+
+    std::vector<std::thread> mWorkers;
+    std::queue<std::function<void()>> mJobs;
+    std::mutex mMutex;
+    std::condition_variable mJobAvailable;
+    bool mStopping = false;
+};
+} // namespace Pikzel
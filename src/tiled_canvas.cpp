@@ -0,0 +1,160 @@
+#include "tiled_canvas.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+namespace Pikzel
+{
+TiledCanvas::TiledCanvas(Vec2Int canvas_dims,
+                         bool track_changes /*= false*/)
+    : mCanvasDims{canvas_dims},
+      mTilesPerRow{(canvas_dims.x + kTileSize - 1) / kTileSize},
+      mTrackChanges{track_changes}
+{
+    const auto tiles_per_col = (canvas_dims.y + kTileSize - 1) / kTileSize;
+    mTiles.assign(static_cast<std::size_t>(mTilesPerRow) * tiles_per_col,
+                  GetEmptyTile());
+    mIsTileChanged.assign(mTiles.size(), false);
+}
+
+void TiledCanvas::FillRow(int row, int x_begin, int x_end, Color color)
+{
+    while (x_begin < x_end)
+    {
+        const Vec2Int coords{x_begin, row};
+        const int tile_end =
+            std::min(((x_begin / kTileSize) + 1) * kTileSize, x_end);
+        auto& tile = GetMutableTile(TileIndexOf(coords));
+
+        std::fill_n(tile.begin() + PixelIndexInTile(coords),
+                    tile_end - x_begin, color);
+        x_begin = tile_end;
+    }
+}
+
+void TiledCanvas::CopyRectTo(Rect rect, Color* dst) const
+{
+    for (int i = rect.upper_left.y; i < rect.bottom_right.y; i++)
+    {
+        for (int j = rect.upper_left.x; j < rect.bottom_right.x;)
+        {
+            const Vec2Int coords{j, i};
+            const int tile_end = std::min(((j / kTileSize) + 1) * kTileSize,
+                                          rect.bottom_right.x);
+            const auto& tile = GetTile(TileIndexOf(coords));
+
+            dst = std::copy_n(tile.begin() + PixelIndexInTile(coords),
+                              tile_end - j, dst);
+            j = tile_end;
+        }
+    }
+}
+
+void TiledCanvas::Clear()
+{
+    for (std::size_t i = 0; i < mTiles.size(); i++)
+    {
+        if (IsTileEmpty(i)) { continue; }
+
+        RecordChange(i);
+        mTiles[i] = GetEmptyTile();
+    }
+}
+
+auto TiledCanvas::TakeChanges() -> std::vector<TileChange>
+{
+    for (auto& change : mChangedTiles)
+    {
+        auto& handle = mTiles[change.tile_index];
+        mIsTileChanged[change.tile_index] = false;
+
+        // Drawn over with the pixels it already had, so the original goes
+        // back and stays shared with the history
+        if (handle != change.before &&
+            std::memcmp(handle->data(), change.before->data(),
+                        sizeof(Tile)) == 0)
+        {
+            handle = change.before;
+        }
+
+        change.after = handle;
+    }
+
+    std::erase_if(mChangedTiles, [](const TileChange& change)
+                  { return change.after == change.before; });
+
+    return std::exchange(mChangedTiles, {});
+}
+
+void TiledCanvas::ForgetChanges()
+{
+    mChangedTiles.clear();
+    mIsTileChanged.assign(mIsTileChanged.size(), false);
+}
+
+auto TiledCanvas::GetTileRect(std::size_t tile_index) const -> Rect
+{
+    const Vec2Int upper_left{
+        static_cast<int>(tile_index % mTilesPerRow) * kTileSize,
+        static_cast<int>(tile_index / mTilesPerRow) * kTileSize};
+
+    return {.upper_left = upper_left,
+            .bottom_right = {std::min(upper_left.x + kTileSize, mCanvasDims.x),
+                             std::min(upper_left.y + kTileSize,
+                                      mCanvasDims.y)}};
+}
+
+auto TiledCanvas::GetMutableTile(std::size_t tile_index) -> Tile&
+{
+    RecordChange(tile_index);
+    if (mTiles[tile_index] == nullptr) { LoadTile(tile_index); }
+
+    auto& handle = mTiles[tile_index];
+
+    // The empty tile is always shared, since GetEmptyTile holds a handle too
+    if (handle.use_count() > 1) { handle = std::make_shared<Tile>(*handle); }
+
+    return *handle;
+}
+
+void TiledCanvas::LoadAllTiles()
+{
+    if (!mTileLoader) { return; }
+
+    for (std::size_t i = 0; i < mTiles.size(); i++)
+    {
+        if (mTiles[i] == nullptr) { LoadTile(i); }
+    }
+
+    mTileLoader = nullptr;
+}
+
+void TiledCanvas::LoadTile(std::size_t tile_index) const
+{
+    assert(mTileLoader);
+
+    auto tile = mTileLoader(tile_index);
+    mTiles[tile_index] = tile != nullptr ? std::move(tile) : GetEmptyTile();
+}
+
+void TiledCanvas::RecordChange(std::size_t tile_index)
+{
+    if (!mTrackChanges || mIsTileChanged[tile_index]) { return; }
+
+    // The history needs the real tile from before the change
+    if (mTiles[tile_index] == nullptr) { LoadTile(tile_index); }
+
+    mIsTileChanged[tile_index] = true;
+    mChangedTiles.push_back({.tile_index = tile_index,
+                             .before = mTiles[tile_index],
+                             .after = nullptr});
+}
+
+auto TiledCanvas::GetEmptyTile() -> const TileHandle&
+{
+    static const TileHandle kEmptyTile = std::make_shared<Tile>();
+    return kEmptyTile;
+}
+} // namespace Pikzel
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "color.hpp"
+#include "rect.hpp"
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Pikzel
+{
+// Pixels of a layer, split into kTileSize x kTileSize tiles held by shared
+// handles. Copying a canvas only copies the handles, a tile gets cloned the
+// first time it's written to while it's shared (copy-on-write). Tiles which
+// were never drawn on all point to one shared transparent tile.
+class TiledCanvas
+{
+  public:
+    static constexpr int kTileSize = 64;
+    static constexpr std::size_t kTilePixelCount =
+        static_cast<std::size_t>(kTileSize) * kTileSize;
+
+    using Tile = std::array<Color, kTilePixelCount>;
+    using TileHandle = std::shared_ptr<Tile>;
+    // Creates tile 'tile_index' the first time it's accessed, see
+    // SetTileLoader. Can be called from several threads at once.
+    using TileLoader = std::function<TileHandle(std::size_t tile_index)>;
+
+    // A tile written to since the last TakeChanges, with its handle from
+    // before the first write
+    struct TileChange
+    {
+        std::size_t tile_index;
+        TileHandle before;
+        TileHandle after;
+    };
+
+    TiledCanvas() = default;
+    // With 'track_changes' every tile written to is remembered for the
+    // undo history, see TakeChanges
+    explicit TiledCanvas(Vec2Int canvas_dims, bool track_changes = false);
+
+    [[nodiscard]] auto GetPixel(Vec2Int coords) const -> Color
+    {
+        return GetTile(TileIndexOf(coords))[PixelIndexInTile(coords)];
+    }
+    void SetPixel(Vec2Int coords, Color color)
+    {
+        GetMutableTile(TileIndexOf(coords))[PixelIndexInTile(coords)] = color;
+    }
+    // Sets the pixels in [x_begin, x_end) of the row
+    void FillRow(int row, int x_begin, int x_end, Color color);
+    // Copies the pixels inside of the rect to 'dst', row by row, with no
+    // padding in between the rows
+    void CopyRectTo(Rect rect, Color* dst) const;
+    // Makes every tile the shared transparent one
+    void Clear();
+    // Returns the tiles changed since the last call, with the handles from
+    // before and after the changes. Tiles which ended up with the same
+    // pixels aren't changes.
+    auto TakeChanges() -> std::vector<TileChange>;
+    void ForgetChanges();
+    [[nodiscard]] auto HasChanges() const -> bool
+    {
+        return !mChangedTiles.empty();
+    }
+
+    [[nodiscard]] auto GetCanvasDims() const -> Vec2Int { return mCanvasDims; }
+    [[nodiscard]] auto GetTilesPerRow() const -> int { return mTilesPerRow; }
+    [[nodiscard]] auto GetTileCount() const -> std::size_t
+    {
+        return mTiles.size();
+    }
+    // Tile 'tile_index' covers this rect, clipped to the canvas
+    [[nodiscard]] auto GetTileRect(std::size_t tile_index) const -> Rect;
+    [[nodiscard]] auto TileIndexOf(Vec2Int coords) const -> std::size_t
+    {
+        return (static_cast<std::size_t>(coords.y / kTileSize) *
+                mTilesPerRow) +
+               (coords.x / kTileSize);
+    }
+    [[nodiscard]] auto GetTile(std::size_t tile_index) const -> const Tile&
+    {
+        return *GetTileHandle(tile_index);
+    }
+    // Clones the tile first if it's shared with another canvas
+    auto GetMutableTile(std::size_t tile_index) -> Tile&;
+    [[nodiscard]] auto GetTileHandle(std::size_t tile_index) const
+        -> const TileHandle&
+    {
+        if (mTiles[tile_index] == nullptr) { LoadTile(tile_index); }
+
+        return mTiles[tile_index];
+    }
+    // Doesn't count as a change, used to apply the undo history
+    void SetTileHandle(std::size_t tile_index, TileHandle handle)
+    {
+        mTiles[tile_index] = std::move(handle);
+    }
+    // Doesn't load the tile
+    [[nodiscard]] auto IsTileEmpty(std::size_t tile_index) const -> bool
+    {
+        return mTiles[tile_index] == GetEmptyTile();
+    }
+    // Tiles with a null handle are created by 'loader' when they're first
+    // read or written. Lets big files be opened without decoding them.
+    void SetTileLoader(TileLoader loader) { mTileLoader = std::move(loader); }
+    // Loads the remaining tiles and drops the loader, along with whatever
+    // it holds
+    void LoadAllTiles();
+
+    static auto PixelIndexInTile(Vec2Int coords) -> std::size_t
+    {
+        return (static_cast<std::size_t>(coords.y % kTileSize) * kTileSize) +
+               (coords.x % kTileSize);
+    }
+    // The transparent tile shared by every canvas
+    static auto GetEmptyTile() -> const TileHandle&;
+
+  private:
+    void RecordChange(std::size_t tile_index);
+    void LoadTile(std::size_t tile_index) const;
+
+    // Null until loaded, if there's a loader. Different tiles can be loaded
+    // by different threads at the same time, like when compositing.
+    mutable std::vector<TileHandle> mTiles;
+    TileLoader mTileLoader;
+    Vec2Int mCanvasDims{0, 0};
+    int mTilesPerRow = 0;
+    bool mTrackChanges = false;
+    // Handles of the changed tiles from before their first write. Holding
+    // them also keeps the tiles shared, so the first write clones them.
+    std::vector<TileChange> mChangedTiles;
+    std::vector<bool> mIsTileChanged;
+};
+} // namespace Pikzel
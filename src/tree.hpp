@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -38,6 +39,7 @@ template <typename T> class Tree
 
     auto GetParent() const -> Node* { return mParent; }
     auto GetData() const -> const T& { return *mData; }
+    auto GetData() -> T& { return *mData; }
     auto GetChildren() const -> const std::vector<std::unique_ptr<Node>>&
     {
         return mChildren;
@@ -51,6 +53,24 @@ template <typename T> class Tree
         return mChildLastUsedIndex;
     }
 
+    // Detaches the child, which becomes the root of its own tree
+    auto ReleaseChild(std::size_t index) -> std::unique_ptr<Node>
+    {
+        auto child = std::move(mChildren[index]);
+        RemoveChild(index);
+        child->mParent = nullptr;
+        return child;
+    }
+
+    // Deletes the child with all its descendants
+    void RemoveChild(std::size_t index)
+    {
+        mChildren.erase(mChildren.begin() + static_cast<std::ptrdiff_t>(index));
+
+        if (mChildLastUsedIndex > index) { mChildLastUsedIndex--; }
+        else if (mChildLastUsedIndex == index) { mChildLastUsedIndex = 0; }
+    }
+
   private:
     template <typename... Args>
     explicit Tree(Node* parent, Args&&... args)
@@ -0,0 +1,101 @@
+#include "undo_journal.hpp"
+
+#include <filesystem>
+#include <iostream>
+
+namespace Pikzel
+{
+UndoJournal::~UndoJournal()
+{
+    Close();
+}
+
+auto UndoJournal::Open(const std::string& path) -> bool
+{
+    Close();
+
+    mFile.open(path, std::ios::binary | std::ios::trunc);
+
+    if (!mFile.is_open())
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't create the undo journal " << path
+                  << " in UndoJournal::Open\n";
+#endif
+        return false;
+    }
+
+    mPath = path;
+    mSize = 0;
+    return true;
+}
+
+void UndoJournal::Close()
+{
+    if (!IsOpen()) { return; }
+
+    // Windows can't delete a mapped file
+    mMapping.Unmap();
+    mFile.close();
+
+    std::error_code error;
+    std::filesystem::remove(mPath, error);
+
+    mPath.clear();
+    mSize = 0;
+}
+
+auto UndoJournal::Reset() -> bool
+{
+    if (!IsOpen()) { return false; }
+
+    const std::string path = mPath;
+    return Open(path);
+}
+
+auto UndoJournal::Append(std::span<const std::byte> data)
+    -> std::optional<Entry>
+{
+    if (!IsOpen()) { return std::nullopt; }
+
+    mFile.write(reinterpret_cast<const char*>(data.data()),
+                static_cast<std::streamsize>(data.size()));
+    // Read maps the file, the entry can't be left in the stream's buffer
+    mFile.flush();
+
+    if (!mFile)
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't write to the undo journal " << mPath
+                  << " in UndoJournal::Append\n";
+#endif
+        // Whatever got written is dropped, so the entries after it land
+        // where they're expected
+        mFile.clear();
+        mFile.seekp(static_cast<std::streamoff>(mSize));
+        return std::nullopt;
+    }
+
+    const Entry entry{.offset = mSize, .size = data.size()};
+    mSize += data.size();
+    return entry;
+}
+
+auto UndoJournal::Read(Entry entry) -> std::span<const std::byte>
+{
+    if (!IsOpen() || entry.offset + entry.size > mSize) { return {}; }
+
+    if (entry.offset + entry.size > mMapping.GetData().size() &&
+        (!mMapping.Map(mPath) ||
+         entry.offset + entry.size > mMapping.GetData().size()))
+    {
+#ifndef NDEBUG
+        std::cerr << "Couldn't map the undo journal " << mPath
+                  << " in UndoJournal::Read\n";
+#endif
+        return {};
+    }
+
+    return mMapping.GetData().subspan(entry.offset, entry.size);
+}
+} // namespace Pikzel
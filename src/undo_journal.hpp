@@ -0,0 +1,53 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+
+namespace Pikzel
+{
+// Append only file for undo history which doesn't fit in memory. Entries are
+// written with plain appends and read back through a memory mapping, which
+// gets remapped once the file grew past it.
+class UndoJournal
+{
+  public:
+    struct Entry
+    {
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    UndoJournal() = default;
+    UndoJournal(const UndoJournal&) = delete;
+    UndoJournal(UndoJournal&&) = delete;
+    auto operator=(const UndoJournal&) -> UndoJournal& = delete;
+    auto operator=(UndoJournal&&) -> UndoJournal& = delete;
+    ~UndoJournal();
+
+    // Creates the file, or empties it if it exists
+    auto Open(const std::string& path) -> bool;
+    // Closes and deletes the file
+    void Close();
+    // Drops all the entries
+    auto Reset() -> bool;
+    // The entry is flushed to the file by the time it's returned
+    auto Append(std::span<const std::byte> data) -> std::optional<Entry>;
+    // Valid until the next call to Read, Reset or Close. Empty if the file
+    // couldn't be mapped up to the end of the entry.
+    auto Read(Entry entry) -> std::span<const std::byte>;
+
+    [[nodiscard]] auto IsOpen() const -> bool { return mFile.is_open(); }
+    [[nodiscard]] auto GetSize() const -> std::size_t { return mSize; }
+
+  private:
+    std::string mPath;
+    std::ofstream mFile;
+    std::size_t mSize = 0;
+    MappedFile mMapping;
+};
+} // namespace Pikzel
@@ -0,0 +1,200 @@
+#include "upscale.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#define PIKZEL_UPSCALE_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#define PIKZEL_UPSCALE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Pikzel::Upscale
+{
+namespace
+{
+static_assert(sizeof(Color) == 4, "Color has to be tightly packed RGBA8");
+
+#if defined(PIKZEL_UPSCALE_SSE2)
+auto LoadPixel(const Color* pixel) -> int32_t
+{
+    int32_t bits = 0;
+    std::memcpy(&bits, pixel, sizeof(bits));
+    return bits;
+}
+
+void Store(Color* dst, __m128i pixels)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), pixels);
+}
+
+// Returns how many pixels were widened, the rest is left for the scalar
+// loop
+auto WidenRowSimd(Color* dst, const Color* src, std::size_t count,
+                  std::size_t factor) -> std::size_t
+{
+    constexpr std::size_t kLanes = 4;
+    std::size_t i = 0;
+
+    if (factor == 2)
+    {
+        for (; i + kLanes <= count; i += kLanes)
+        {
+            const __m128i pixels =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            Store(dst + (i * 2), _mm_unpacklo_epi32(pixels, pixels));
+            Store(dst + (i * 2) + kLanes, _mm_unpackhi_epi32(pixels, pixels));
+        }
+    }
+    else if (factor == 3)
+    {
+        for (; i + kLanes <= count; i += kLanes)
+        {
+            const __m128i pixels =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            Color* out = dst + (i * 3);
+            Store(out, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(1, 0, 0, 0)));
+            Store(out + kLanes,
+                  _mm_shuffle_epi32(pixels, _MM_SHUFFLE(2, 2, 1, 1)));
+            Store(out + (2 * kLanes),
+                  _mm_shuffle_epi32(pixels, _MM_SHUFFLE(3, 3, 3, 2)));
+        }
+    }
+#if defined(PIKZEL_UPSCALE_AVX2)
+    else if (factor >= 8)
+    {
+        constexpr std::size_t kWideLanes = 8;
+
+        // The last store of a pixel may overlap the one before, with the
+        // same value
+        for (; i < count; i++)
+        {
+            const __m256i pixel = _mm256_set1_epi32(LoadPixel(src + i));
+            Color* out = dst + (i * factor);
+
+            for (std::size_t j = 0; j + kWideLanes <= factor; j += kWideLanes)
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j),
+                                    pixel);
+            }
+
+            _mm256_storeu_si256(
+                reinterpret_cast<__m256i*>(out + factor - kWideLanes), pixel);
+        }
+    }
+#endif
+    else if (factor >= kLanes)
+    {
+        // The last store of a pixel may overlap the one before, with the
+        // same value
+        for (; i < count; i++)
+        {
+            const __m128i pixel = _mm_set1_epi32(LoadPixel(src + i));
+            Color* out = dst + (i * factor);
+
+            for (std::size_t j = 0; j + kLanes <= factor; j += kLanes)
+            {
+                Store(out + j, pixel);
+            }
+
+            Store(out + factor - kLanes, pixel);
+        }
+    }
+
+    return i;
+}
+#endif
+} // namespace
+
+void WidenRow(Color* dst, const Color* src, std::size_t count,
+              std::size_t factor)
+{
+    assert(factor != 0);
+
+    if (factor == 1)
+    {
+        std::copy_n(src, count, dst);
+        return;
+    }
+
+    std::size_t i = 0;
+
+#if defined(PIKZEL_UPSCALE_SSE2)
+    i = WidenRowSimd(dst, src, count, factor);
+#endif
+
+    for (; i < count; i++) { std::fill_n(dst + (i * factor), factor, src[i]); }
+}
+
+void WidenRow(uint8_t* dst, const uint8_t* src, std::size_t count,
+              std::size_t factor)
+{
+    // A quarter of the bytes of a Color row, fill_n is a memset
+    for (std::size_t i = 0; i < count; i++)
+    {
+        std::fill_n(dst + (i * factor), factor, src[i]);
+    }
+}
+
+void WidenRows(std::span<Color> dst, std::span<const Color> src,
+               std::size_t width, std::size_t factor)
+{
+    assert(width != 0 && src.size() % width == 0);
+    assert(dst.size() == src.size() * factor);
+
+    const auto row_count = src.size() / width;
+    auto& pool = ThreadPool::Get();
+    const auto band_count = std::min(row_count, pool.GetConcurrency());
+
+    pool.ParallelFor(
+        band_count,
+        [&](std::size_t band)
+        {
+            const auto first = row_count * band / band_count;
+            const auto last = row_count * (band + 1) / band_count;
+
+            for (auto row = first; row < last; row++)
+            {
+                WidenRow(&dst[row * width * factor], &src[row * width], width,
+                         factor);
+            }
+        });
+}
+
+void UpscaleImage(std::span<Color> dst, std::span<const Color> src,
+                  std::size_t width, std::size_t factor)
+{
+    assert(width != 0 && src.size() % width == 0);
+    assert(dst.size() == src.size() * factor * factor);
+
+    const auto row_count = src.size() / width;
+    const auto dst_width = width * factor;
+    auto& pool = ThreadPool::Get();
+    const auto band_count = std::min(row_count, pool.GetConcurrency());
+
+    pool.ParallelFor(
+        band_count,
+        [&](std::size_t band)
+        {
+            const auto first = row_count * band / band_count;
+            const auto last = row_count * (band + 1) / band_count;
+
+            for (auto row = first; row < last; row++)
+            {
+                auto* widened = &dst[row * factor * dst_width];
+                WidenRow(widened, &src[row * width], width, factor);
+
+                for (std::size_t i = 1; i < factor; i++)
+                {
+                    std::copy_n(widened, dst_width, widened + (i * dst_width));
+                }
+            }
+        });
+}
+} // namespace Pikzel::Upscale
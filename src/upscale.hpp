@@ -0,0 +1,29 @@
+#pragma once
+
+#include "color.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Nearest neighbour upscaling by a whole factor, for magnified exports
+namespace Pikzel::Upscale
+{
+// Repeats each of the 'count' pixels of 'src' 'factor' times into 'dst',
+// which has to have room for count * factor pixels. Uses AVX2 or SSE2 if
+// the build targets them.
+void WidenRow(Color* dst, const Color* src, std::size_t count,
+              std::size_t factor);
+// Same, for the palette indices of an indexed image
+void WidenRow(uint8_t* dst, const uint8_t* src, std::size_t count,
+              std::size_t factor);
+// Widens every row of 'src', each 'width' pixels, into 'dst'. Bands of rows
+// are spread over the thread pool. Repeating the rows is left to the
+// caller, a widened row can be used 'factor' times as it is.
+void WidenRows(std::span<Color> dst, std::span<const Color> src,
+               std::size_t width, std::size_t factor);
+// Both ways, 'dst' gets factor * factor pixels for each one of 'src'. For
+// when the whole image is needed at once.
+void UpscaleImage(std::span<Color> dst, std::span<const Color> src,
+                  std::size_t width, std::size_t factor);
+} // namespace Pikzel::Upscale